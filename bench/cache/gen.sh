@@ -0,0 +1,12 @@
+#!/bin/sh
+# startup workload for the unit cache: 200 files of about 50 KB, each test.ycc repeated with
+# its functions and structs renamed, and a main that returns at once. time it with
+# --rebuild-cache (parse and write), --no-cache (parse only) and with no option (warm cache).
+src=../../../test.ycc
+names='main|testvar|testref|testarr|getPrime|printPrime|testIfElseWhile|testStruct|testall|A|B'
+for f in $(seq -w 0 199); do
+    for i in $(seq 0 39); do
+        sed -E "s/\b($names)\b/\1x${f}y$i/g" "$src"
+    done > "f$f.ycc"
+done
+echo 'def main(){ return 0; }' > main.ycc
@@ -0,0 +1,30 @@
+#!/bin/sh
+# lexer workload: big.ycc is about 16 MB of functions mixing keywords, names, int, float and
+# string constants, every operator and bracket, with the indentation of hand written code.
+# main returns at once, so a run is mostly lexing and parsing; bench/run.sh prints lexing on
+# its own next to the time of the whole run.
+echo 'def main(){ return 0; }' > main.ycc
+awk 'BEGIN {
+    for (f = 0; f < 30000; f++) {
+        print "def lex" f "(alpha, beta, gamma){"
+        print "    total = 0;"
+        print "    name = \"function number " f " of the lexer benchmark\";"
+        print "    for(i = 0; i < len(alpha); i = i + 1){"
+        print "        if(alpha[i] <= beta && gamma != " f "){"
+        print "            total = total + alpha[i] * 3.25 - beta.value;"
+        print "        } else {"
+        print "            total = total - " f * 7 % 1000 " + gamma[i + 1];"
+        print "        }"
+        print "        while(total >= 1000000 || total == 0.5e-3){"
+        print "            total = total - 1000000;"
+        print "        }"
+        print "    }"
+        print "    point = let P;"
+        print "    point.x = &total;"
+        print "    items = arr int 16;"
+        print "    println(name + \": \" + total);"
+        print "    return total;"
+        print "}"
+        print ""
+    }
+}' > big.ycc
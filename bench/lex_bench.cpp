@@ -0,0 +1,43 @@
+// lexing throughput: tokenizes every .ycc file in the current directory the way the parser
+// reads it, through a TokenStream, and prints the best of a few runs in MB/s. bench/run.sh
+// runs it next to Demo, so lexing shows apart from the whole parse.
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../src/Token.h"
+
+int main(int argc, char** argv) {
+    int runs = argc > 1 ? std::max(1, std::atoi(argv[1])) : 5;
+    std::vector<std::string> sources;
+    size_t bytes = 0, tokens = 0;
+    for (auto& entry : std::filesystem::directory_iterator(".")) {
+        if (entry.path().extension() != ".ycc") continue;
+        std::ifstream in(entry.path(), std::ios::binary);
+        std::stringstream text;
+        text << in.rdbuf();
+        sources.push_back(text.str());
+        bytes += sources.back().size();
+    }
+    double best = 0;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        tokens = 0;
+        for (auto& source : sources) {
+            // a std::string keeps the '\0' after its text the tokenizer relies on
+            auto stream = Tokenizer::get_token_stream(source);
+            for (; !stream.end(); tokens++) stream.get();
+        }
+        std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+        if (i == 0 || time.count() < best) best = time.count();
+    }
+    double mb = bytes / 1e6;
+    std::printf("lexing: %.1f MB/s, %.1f MB and %zu tokens in %.0f ms\n", mb / best, mb, tokens,
+                best * 1000);
+    return 0;
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+# number <-> text workloads: main.ycc turns 400k floats and ints into strings by concatenation,
+# literals.ycc has 100k int and float constants for the lexer and the constant parser.
+cat > main.ycc <<'YCC'
+def main(){
+    x = 0.5;
+    n = 0;
+    for(i = 0; i < 400000; i = i + 1){
+        s = "" + x;
+        t = i + ",";
+        n = n + len(s) + len(t);
+        x = x * 1.00003 + 0.25;
+    }
+    println(n);
+    return 0;
+}
+YCC
+awk 'BEGIN {
+    for (f = 0; f < 500; f++) {
+        print "def literals" f "(a){"
+        for (i = 0; i < 20; i++) {
+            n = f * 20 + i
+            line = "y = a"
+            for (k = 0; k < 10; k++) {
+                if (k % 2) line = line " + " (n * 7919 + k * 104729) % 1000003
+                else line = line " * " (n * 13 + k) / 997 "e-" (n + k) % 12
+            }
+            print line ";"
+        }
+        print "return y;"
+        print "}"
+    }
+}' > literals.ycc
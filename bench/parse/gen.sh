@@ -0,0 +1,41 @@
+#!/bin/sh
+# parser workloads: nested.ycc has 3000 statements 150 levels deep, flat.ycc 20k expressions
+# mixing every binary operator, calls, subscripts and groups. main runs none of them.
+awk 'BEGIN {
+    print "def main(){ return 0; }"
+    for (f = 0; f < 20; f++) {
+        print "def nested" f "(a, b, c){"
+        for (d = 0; d < 150; d++) {
+            print "if (a < " d ") {"
+            print "x" d " = (a + b * " d ") * (c - " f ") + a[b] * (b + c * (a - 1));"
+        }
+        for (d = 0; d < 150; d++) print "}"
+        print "return 0;"
+        print "}"
+    }
+}' > nested.ycc
+awk 'BEGIN {
+    ops[0] = "+"; ops[1] = "-"; ops[2] = "*"; ops[3] = "<"; ops[4] = "=="; ops[5] = "&&"
+    for (f = 0; f < 200; f++) {
+        print "def flat" f "(a, b, c){"
+        for (i = 0; i < 100; i++) {
+            n = f * 100 + i
+            line = "y = a"
+            for (k = 0; k < 8; k++) {
+                op = ops[(n + k * 7) % 6]
+                if ((n + k) % 5 == 0) {
+                    line = line " " op " f" (n % 3) "(b, " k ")"
+                } else if ((n + k) % 5 == 1) {
+                    line = line " " op " (c " ops[k % 3] " " n ")"
+                } else if ((n + k) % 5 == 2) {
+                    line = line " " op " a[" k "]"
+                } else {
+                    line = line " " op " " (n * 31 + k) % 1000
+                }
+            }
+            print line ";"
+        }
+        print "return y;"
+        print "}"
+    }
+}' > flat.ycc
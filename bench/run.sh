@@ -0,0 +1,32 @@
+#!/bin/sh
+# usage: bench/run.sh DEMO DIR [RUNS [DEMO OPTIONS...]]
+# runs DEMO in DIR RUNS times (5 by default) and prints the best wall time. a DIR with a
+# gen.sh gets its scripts generated into DIR/out first; input.txt in the directory the scripts
+# are in is fed to the program's input(). when lex_bench was built next to DEMO, the
+# throughput of lexing the same scripts follows on its own line.
+set -e
+demo=$(realpath "$1")
+dir=$(realpath "$2")
+runs=${3:-5}
+shift 2
+[ $# -gt 0 ] && shift
+if [ -x "$dir/gen.sh" ]; then
+    if [ ! -d "$dir/out" ]; then
+        mkdir "$dir/out"
+        (cd "$dir/out" && ../gen.sh)
+    fi
+    dir="$dir/out"
+fi
+cd "$dir"
+input=/dev/null
+[ -f input.txt ] && input=input.txt
+best=
+for i in $(seq "$runs"); do
+    start=$(date +%s%N)
+    "$demo" "$@" < "$input" > /dev/null
+    ms=$(( ($(date +%s%N) - start) / 1000000 ))
+    if [ -z "$best" ] || [ "$ms" -lt "$best" ]; then best=$ms; fi
+done
+echo "$best ms  $(basename "$(dirname "$dir")")/$(basename "$dir") $*"
+lexer=$(dirname "$demo")/lex_bench
+[ -x "$lexer" ] && "$lexer" "$runs"
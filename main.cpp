@@ -1,5 +1,5 @@
 #include "src/Vm.h"
-int main() {
-    VM vm;
-    vm.run();
+int main(int argc, char** argv) {
+    VM vm(VMOptions::parse(argc, argv));
+    return vm.run();
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <new>
+#include <span>
+#include <type_traits>
+#include <utility>
+
+// bump-pointer arena that owns every ast and expression node of a program. objects are
+// never freed one by one: clear() (or the destructor) runs the registered destructors in
+// reverse order and releases all chunks at once.
+class Arena {
+public:
+    constexpr static size_t chunk_size = 64 * 1024;
+
+    Arena() = default;
+    ~Arena() { clear(); }
+
+    Arena(Arena&& rhs) noexcept { swap(rhs); }
+    Arena& operator=(Arena&& rhs) noexcept {
+        if (this != &rhs) {
+            clear();
+            swap(rhs);
+        }
+        return *this;
+    }
+
+    void* allocate(size_t size, size_t align = alignof(std::max_align_t)) {
+        auto cur = (reinterpret_cast<uintptr_t>(_cur) + align - 1) & ~(uintptr_t)(align - 1);
+        if (_cur == nullptr || cur + size > reinterpret_cast<uintptr_t>(_end)) {
+            new_chunk(size + align);
+            cur = (reinterpret_cast<uintptr_t>(_cur) + align - 1) & ~(uintptr_t)(align - 1);
+        }
+        _cur = reinterpret_cast<char*>(cur + size);
+        _used_bytes += size;
+        return reinterpret_cast<void*>(cur);
+    }
+
+    template <class T, class... Args>
+    T* create(Args&&... args) {
+        void* ptr = allocate(sizeof(T), alignof(T));
+        T* obj = new (ptr) T(std::forward<Args>(args)...);
+        if constexpr (!std::is_trivially_destructible_v<T>) {
+            auto* dtor = new (allocate(sizeof(Destructor), alignof(Destructor))) Destructor {
+                    _destructors, obj, [](void* p) { static_cast<T*>(p)->~T(); }};
+            if (_destructors == nullptr) _oldest_destructor = dtor;
+            _destructors = dtor;
+        }
+        return obj;
+    }
+
+    // uninitialized storage for n trivially destructible elements
+    template <class T>
+    std::span<T> alloc_array(size_t n) {
+        static_assert(std::is_trivially_destructible_v<T>);
+        if (n == 0) return {};
+        auto* ptr = static_cast<T*>(allocate(sizeof(T) * n, alignof(T)));
+        return {ptr, n};
+    }
+
+    template <class T>
+    std::span<T> copy_array(std::span<const T> src) {
+        auto dst = alloc_array<T>(src.size());
+        std::uninitialized_copy(src.begin(), src.end(), dst.begin());
+        return dst;
+    }
+
+    void clear() {
+        for (auto* dtor = _destructors; dtor; dtor = dtor->next) {
+            dtor->fn(dtor->obj);
+        }
+        _destructors = _oldest_destructor = nullptr;
+        for (auto* chunk = _chunks; chunk;) {
+            auto* prev = chunk->prev;
+            std::free(chunk);
+            chunk = prev;
+        }
+        _chunks = _oldest_chunk = nullptr;
+        _cur = _end = nullptr;
+        _used_bytes = _reserved_bytes = 0;
+        _chunk_count = 0;
+    }
+
+    // take over every object of src in constant time, src is left empty
+    void acquire_data(Arena* src) {
+        if (src->_destructors) {
+            src->_oldest_destructor->next = _destructors;
+            if (_destructors == nullptr) _oldest_destructor = src->_oldest_destructor;
+            _destructors = src->_destructors;
+        }
+        if (src->_chunks) {
+            // keep bumping in our own current chunk, src's chunks are only linked in
+            if (_chunks) {
+                src->_oldest_chunk->prev = _chunks->prev;
+                if (_chunks->prev == nullptr) _oldest_chunk = src->_oldest_chunk;
+                _chunks->prev = src->_chunks;
+            } else {
+                _chunks = src->_chunks;
+                _oldest_chunk = src->_oldest_chunk;
+                _cur = src->_cur;
+                _end = src->_end;
+            }
+        }
+        _used_bytes += src->_used_bytes;
+        _reserved_bytes += src->_reserved_bytes;
+        _chunk_count += src->_chunk_count;
+        src->_destructors = src->_oldest_destructor = nullptr;
+        src->_chunks = src->_oldest_chunk = nullptr;
+        src->_cur = src->_end = nullptr;
+        src->_used_bytes = src->_reserved_bytes = 0;
+        src->_chunk_count = 0;
+    }
+
+    size_t used_bytes() const { return _used_bytes; }
+    size_t reserved_bytes() const { return _reserved_bytes; }
+    size_t chunk_count() const { return _chunk_count; }
+
+private:
+    Arena(const Arena&) = delete;
+    void operator=(const Arena&) = delete;
+
+    struct Chunk {
+        Chunk* prev;
+    };
+
+    struct Destructor {
+        Destructor* next;
+        void* obj;
+        void (*fn)(void*);
+    };
+
+    void new_chunk(size_t min_size) {
+        size_t size = std::max(chunk_size, min_size + sizeof(Chunk));
+        auto* chunk = static_cast<Chunk*>(std::malloc(size));
+        if (chunk == nullptr) throw std::bad_alloc();
+        chunk->prev = _chunks;
+        if (_chunks == nullptr) _oldest_chunk = chunk;
+        _chunks = chunk;
+        _cur = reinterpret_cast<char*>(chunk + 1);
+        _end = reinterpret_cast<char*>(chunk) + size;
+        _reserved_bytes += size;
+        _chunk_count++;
+    }
+
+    void swap(Arena& rhs) {
+        std::swap(_cur, rhs._cur);
+        std::swap(_end, rhs._end);
+        std::swap(_chunks, rhs._chunks);
+        std::swap(_oldest_chunk, rhs._oldest_chunk);
+        std::swap(_destructors, rhs._destructors);
+        std::swap(_oldest_destructor, rhs._oldest_destructor);
+        std::swap(_used_bytes, rhs._used_bytes);
+        std::swap(_reserved_bytes, rhs._reserved_bytes);
+        std::swap(_chunk_count, rhs._chunk_count);
+    }
+
+    char* _cur = nullptr;
+    char* _end = nullptr;
+    // both lists run newest to oldest, the oldest ends let acquire_data splice them
+    Chunk* _chunks = nullptr;
+    Chunk* _oldest_chunk = nullptr;
+    Destructor* _destructors = nullptr;
+    Destructor* _oldest_destructor = nullptr;
+    size_t _used_bytes = 0;
+    size_t _reserved_bytes = 0;
+    size_t _chunk_count = 0;
+};
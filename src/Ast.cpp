@@ -2,6 +2,20 @@
 
 #include "Token.h"
 
+void FuncNode::compile(CompileUnit* unit, GlobalContext* global) {
+    try {
+        TokenStream stream(unit->source(), _body_offset);
+        Context ctx {nullptr, unit};
+        _stmt = BuildAst::parser_stmt(stream, &ctx);
+    } catch (const ParseError& e) {
+        std::cerr << unit->path().filename().string() << ":" << e.what() << std::endl;
+        exit(1);
+    }
+    _stmt->fold();
+    Context ctx {global};
+    _stmt->prepare(&ctx);
+}
+
 namespace BuildAst {
 const Token Def = Token("def", Token::Type::key_word);
 const Token Struct = Token("struct", Token::key_word);
@@ -12,22 +26,23 @@ void buildAst(TokenStream& stream, Context* ctx) {
             parser_func(stream, ctx);
         } else if (stream.top() == Struct) {
             parser_struct(stream, ctx);
+        } else {
+            stream.error(stream.top(), "expected def or struct but found '" +
+                                               std::string(stream.top().str()) + "'");
         }
     }
-    CHECK(stream.end(), "has other token");
 }
 
 void parser_func(TokenStream& stream, Context* ctx) {
     stream.eat(Def); //eat def
     auto token = stream.eat(Token::Type::variable);
-    std::string function_name = token.str();
+    std::string function_name {token.str()};
     stream.eat("(");
 
     // func_name( arg , arg, arg ....)
-    std::vector<std::string> args_name;
+    std::vector<SymbolId> args_name;
     while (stream.top().str() != ")") {
-        auto arg = stream.eat(Token::Type::variable).str();
-        args_name.push_back(arg);
+        args_name.push_back(stream.eat(Token::Type::variable).symbol());
         if (stream.top().str() != ")") {
             stream.eat(",");
         }
@@ -35,44 +50,47 @@ void parser_func(TokenStream& stream, Context* ctx) {
     stream.eat(")");
     stream.eat("{");
 
-    auto* func_node = ctx->obj_pool()->add(new FuncNode {function_name});
-    ctx->func_mgr()->register_func(function_name, args_name, func_node);
-    auto* stmt_node = parser_stmt(stream, ctx);
-    func_node->set_stmt(stmt_node);
-    ctx->add_func_node(func_node);
-    stream.eat("}");
+    auto* func_node = ctx->arena()->create<FuncNode>(function_name);
+    if (ctx->unit()->lazy()) {
+        // only the braces are matched, the body is parsed on the first call
+        func_node->set_lazy_body(stream.skip_block());
+    } else {
+        auto* stmt_node = parser_stmt(stream, ctx);
+        func_node->set_stmt(stmt_node);
+        stream.eat("}");
+    }
+    ctx->unit()->add_func(token.symbol(), std::move(args_name), func_node);
 }
 
 void parser_struct(TokenStream& stream, Context* ctx) {
     stream.eat(Struct);
-    auto struct_name = stream.eat(Token::Type::variable).str();
+    // struct tables are shared by all files, the declaration is applied when the unit is merged
+    CompileUnit::StructDecl decl;
+    decl.name = stream.eat(Token::Type::variable).symbol();
     if (stream.top_equal("extends")) {
         stream.get();
-        auto extends_strcut_name = stream.eat(Token::Type::variable).str();
-        ctx->struct_info()->extends(struct_name, extends_strcut_name);
+        decl.base = stream.eat(Token::Type::variable).symbol();
     }
     stream.eat("{");
-    std::map<std::string, Value> struct_map;
     while (!stream.top_equal("}")) {
-        auto member_name = stream.eat(Token::Type::variable).str();
+        auto member_name = stream.eat(Token::Type::variable).symbol();
         stream.eat("=");
         if (stream.top_equal(Token::constant)) {
             auto const_token = stream.get();
-            struct_map[member_name] = ExprBuild::parser_constant(const_token);
+            decl.members.push_back({member_name, ExprBuild::parser_constant(const_token)});
         } else if (stream.top() == Struct) {
             stream.get();
-            auto other_struct_name = stream.eat(Token::Type::variable).str();
-            struct_map[member_name] =
-                    ctx->struct_info()->get_default_struct_value(other_struct_name);
+            auto other_struct_name = stream.eat(Token::Type::variable).symbol();
+            decl.members.push_back({member_name, Value::default_value, other_struct_name});
         }
         stream.eat(";");
     }
-    ctx->struct_info()->put_struct_info(struct_name, struct_map);
+    ctx->unit()->add_struct(std::move(decl));
     stream.eat("}");
 }
 StmtNode* parser_stmt(TokenStream& stream, Context* ctx) {
-    auto* pool = ctx->obj_pool();
-    auto* stmt_node = pool->add(new StmtNode {});
+    auto* arena = ctx->arena();
+    std::vector<AstNode*> commands;
     ExprBuild builder;
 
     while (!stream.top_equal("}")) {
@@ -80,31 +98,37 @@ StmtNode* parser_stmt(TokenStream& stream, Context* ctx) {
             auto str = stream.top().str();
             if (str == "if") {
                 stream.get(); // eat if
-                stmt_node->add_command(parser_if(stream, ctx));
+                commands.push_back(parser_if(stream, ctx));
             } else if (str == "while") {
                 stream.get(); // eat while
-                stmt_node->add_command(parser_while(stream, ctx));
+                commands.push_back(parser_while(stream, ctx));
             } else if (str == "else") {
-                stream.get(); // eat else
-                CHECK(stmt_node->back_command()->is_if(), "else must be used after if.");
-                auto* if_node = dynamic_cast<IfNode*>(stmt_node->back_command());
+                const auto& else_token = stream.get(); // eat else
+                if (commands.empty() || !commands.back()->is_if()) {
+                    stream.error(else_token, "else must be used after if");
+                }
+                auto* if_node = dynamic_cast<IfNode*>(commands.back());
                 parser_else(stream, ctx, if_node);
             } else if (str == "for") {
                 stream.get(); // eat for
-                stmt_node->add_command(parser_for(stream, ctx));
+                commands.push_back(parser_for(stream, ctx));
             } else if (str == "foreach") {
                 stream.get(); // eat foreach
-                stmt_node->add_command(parser_foreach(stream, ctx));
+                commands.push_back(parser_foreach(stream, ctx));
             } else if (str == "return") {
                 stream.get(); // eat return
-                stmt_node->add_command(parser_return(stream, ctx));
+                commands.push_back(parser_return(stream, ctx));
+            } else {
+                stream.error(stream.top(), "unexpected '" + std::string(str) + "' in statement");
             }
         } else {
             auto expr = builder.build(ctx, stream);
-            stmt_node->add_command(pool->add(new ExprExecuteNode(expr)));
+            commands.push_back(arena->create<ExprExecuteNode>(expr));
             stream.eat(";");
         }
     }
+    auto* stmt_node = arena->create<StmtNode>();
+    stmt_node->set_commands(arena, commands);
     return stmt_node;
 }
 
@@ -116,7 +140,7 @@ AstNode* parser_while(TokenStream& stream, Context* ctx) {
     stream.eat("{");
     auto* while_stmt = parser_stmt(stream, ctx);
     stream.eat("}");
-    return ctx->obj_pool()->add(new WhileNode(expr, while_stmt));
+    return ctx->arena()->create<WhileNode>(expr, while_stmt);
 }
 
 IfNode* parser_if(TokenStream& stream, Context* ctx) {
@@ -127,7 +151,7 @@ IfNode* parser_if(TokenStream& stream, Context* ctx) {
     stream.eat("{");
     auto* if_stmt = parser_stmt(stream, ctx);
     stream.eat("}");
-    return ctx->obj_pool()->add(new IfNode(expr, if_stmt));
+    return ctx->arena()->create<IfNode>(expr, if_stmt);
 }
 
 void parser_else(TokenStream& stream, Context* ctx, IfNode* if_node) {
@@ -149,27 +173,26 @@ AstNode* parser_for(TokenStream& stream, Context* ctx) {
     stream.eat("{");
     auto* for_stmt = parser_stmt(stream, ctx);
     stream.eat("}");
-    return ctx->obj_pool()->add(new ForNode(expr1, expr2, expr3, for_stmt));
+    return ctx->arena()->create<ForNode>(expr1, expr2, expr3, for_stmt);
 }
 
 AstNode* parser_foreach(TokenStream& stream, Context* ctx) {
     ExprBuild builder;
     stream.eat("(");
-    CHECK(stream.top_equal(Token::Type::variable), "foreach var : arr");
-    auto name = stream.eat(Token::Type::variable).str();
+    auto name = stream.eat(Token::Type::variable).symbol();
     stream.eat(":");
     auto expr = builder.build(ctx, stream);
     stream.eat(")");
     stream.eat("{");
     auto* for_stmt = parser_stmt(stream, ctx);
     stream.eat("}");
-    return ctx->obj_pool()->add(new ForeachNode(expr, name, for_stmt));
+    return ctx->arena()->create<ForeachNode>(expr, name, for_stmt);
 }
 
 AstNode* parser_return(TokenStream& stream, Context* ctx) {
     ExprBuild builder;
     auto ret_expr = builder.build(ctx, stream);
     stream.eat(";");
-    return ctx->obj_pool()->add(new ReturnNode(ret_expr));
+    return ctx->arena()->create<ReturnNode>(ret_expr);
 }
 } // namespace BuildAst
\ No newline at end of file
@@ -2,6 +2,7 @@
 
 #include "Context.h"
 #include "ExprBuild.h"
+#include "Map.h"
 #include "util.h"
 
 struct AstNode {
@@ -10,6 +11,11 @@ struct AstNode {
     [[nodiscard]] virtual bool exec(Context* ctx) { return true; }
 
     virtual void prepare(Context* ctx) {};
+    // context-free part of prepare, done once per unit right after parsing
+    virtual void fold() {}
+    // reachability: the functions and structs the node refers to
+    virtual void collect_refs(ReferenceSink& refs) {}
+    virtual void serialize(UnitWriter& out) { out.fail(); }
 
     virtual ~AstNode() = default;
     virtual bool is_if() const { return false; }
@@ -35,6 +41,13 @@ struct ExprExecuteNode : AstNode {
     }
 
     void prepare(Context* ctx) override { _expr.prepare(ctx); }
+    void fold() override { _expr.fold(); }
+    void collect_refs(ReferenceSink& refs) override { _expr.collect_refs(refs); }
+
+    void serialize(UnitWriter& out) override {
+        out.u8(UnitWriter::expr_stmt_tag);
+        out.expr(_expr.node());
+    }
 
     void debug_string(std::stringstream& out, const std::string& prefix) override {
         out << prefix << counter() << _expr.expr_name() << "\n";
@@ -53,6 +66,13 @@ struct ReturnNode : AstNode {
     }
 
     void prepare(Context* ctx) override { _ret_expr.prepare(ctx); }
+    void fold() override { _ret_expr.fold(); }
+    void collect_refs(ReferenceSink& refs) override { _ret_expr.collect_refs(refs); }
+
+    void serialize(UnitWriter& out) override {
+        out.u8(UnitWriter::return_tag);
+        out.expr(_ret_expr.node());
+    }
 
     void debug_string(std::stringstream& out, const std::string& prefix) override {
         out << prefix << counter() << "return " << _ret_expr.expr_name() << "\n";
@@ -77,8 +97,29 @@ struct StmtNode : AstNode {
         }
     }
 
-    void add_command(AstNode* node) { _command.push_back(node); }
-    AstNode* back_command() { return _command.back(); }
+    void fold() override {
+        for (auto* node : _command) {
+            node->fold();
+        }
+    }
+
+    void collect_refs(ReferenceSink& refs) override {
+        for (auto* node : _command) {
+            node->collect_refs(refs);
+        }
+    }
+
+    void serialize(UnitWriter& out) override {
+        out.u8(UnitWriter::stmt_tag);
+        out.varint(_command.size());
+        for (auto* node : _command) {
+            out.ast(node);
+        }
+    }
+
+    void set_commands(Arena* arena, std::span<AstNode* const> commands) {
+        _command = arena->copy_array<AstNode*>(commands);
+    }
     void debug_string(std::stringstream& out, const std::string& prefix) override {
         for (auto* cmd : _command) {
             cmd->debug_string(out, prefix);
@@ -86,7 +127,7 @@ struct StmtNode : AstNode {
     }
 
 private:
-    std::vector<AstNode*> _command;
+    std::span<AstNode*> _command;
 };
 
 struct IfNode : AstNode {
@@ -112,6 +153,26 @@ struct IfNode : AstNode {
         if (_else_stmt) _else_stmt->prepare(ctx);
     }
 
+    void fold() override {
+        _expr.fold();
+        _if_stmt->fold();
+        if (_else_stmt) _else_stmt->fold();
+    }
+
+    void collect_refs(ReferenceSink& refs) override {
+        _expr.collect_refs(refs);
+        _if_stmt->collect_refs(refs);
+        if (_else_stmt) _else_stmt->collect_refs(refs);
+    }
+
+    void serialize(UnitWriter& out) override {
+        out.u8(UnitWriter::if_tag);
+        out.expr(_expr.node());
+        out.ast(_if_stmt);
+        out.u8(_else_stmt != nullptr);
+        if (_else_stmt) out.ast(_else_stmt);
+    }
+
     void set_else(StmtNode* stmt) { _else_stmt = stmt; }
 
     void debug_string(std::stringstream& out, const std::string& prefix) override {
@@ -145,6 +206,22 @@ struct WhileNode : AstNode {
         _while_stmt->prepare(ctx);
     }
 
+    void fold() override {
+        _expr.fold();
+        _while_stmt->fold();
+    }
+
+    void collect_refs(ReferenceSink& refs) override {
+        _expr.collect_refs(refs);
+        _while_stmt->collect_refs(refs);
+    }
+
+    void serialize(UnitWriter& out) override {
+        out.u8(UnitWriter::while_tag);
+        out.expr(_expr.node());
+        out.ast(_while_stmt);
+    }
+
     void debug_string(std::stringstream& out, const std::string& prefix) override {
         out << prefix << counter() << "while " << _expr.expr_name() << "\n";
         _while_stmt->debug_string(out, prefix + "\t");
@@ -176,6 +253,28 @@ struct ForNode : AstNode {
         _for_stmt->prepare(ctx);
     }
 
+    void fold() override {
+        _expr1.fold();
+        _expr2.fold();
+        _expr3.fold();
+        _for_stmt->fold();
+    }
+
+    void collect_refs(ReferenceSink& refs) override {
+        _expr1.collect_refs(refs);
+        _expr2.collect_refs(refs);
+        _expr3.collect_refs(refs);
+        _for_stmt->collect_refs(refs);
+    }
+
+    void serialize(UnitWriter& out) override {
+        out.u8(UnitWriter::for_tag);
+        out.expr(_expr1.node());
+        out.expr(_expr2.node());
+        out.expr(_expr3.node());
+        out.ast(_for_stmt);
+    }
+
     void debug_string(std::stringstream& out, const std::string& prefix) override {
         out << prefix << counter() << "for " << _expr1.expr_name() << " " << _expr2.expr_name()
             << " " << _expr3.expr_name() << "\n";
@@ -190,12 +289,24 @@ private:
 };
 
 struct ForeachNode : AstNode {
-    ForeachNode(Expr& expr, const std::string var_name, StmtNode* for_stmt)
+    ForeachNode(Expr& expr, SymbolId var_name, StmtNode* for_stmt)
             : _expr(std::move(expr)), _var_name(var_name), _for_stmt(for_stmt) {}
     [[nodiscard]] bool exec(Context* ctx) override {
-        auto arr = _expr(ctx);
-        for (Value v : arr.get_arr()) {
-            ctx->func()->variable_mgr()->set(_var_name, v);
+        // the loop walks a snapshot, writes to the array in the body copy it first. a ref is
+        // followed here, so the snapshot holds the array and not the ref.
+        Value arr = _expr(ctx).deref();
+        if (arr.is_map()) {
+            // each entry as a struct with members key and value, in insertion order
+            auto& map = arr.get_map();
+            for (size_t i = 0; i < map.size(); i++) {
+                ctx->func()->variable_mgr()->set(_var_name, map.entry(i));
+                RETURN_IF_TRUE(_for_stmt->exec(ctx));
+            }
+            return false;
+        }
+        auto& items = arr.get_array();
+        for (size_t i = 0; i < items.size(); i++) {
+            ctx->func()->variable_mgr()->set(_var_name, items.get(i));
             RETURN_IF_TRUE(_for_stmt->exec(ctx));
         }
         return false;
@@ -206,8 +317,26 @@ struct ForeachNode : AstNode {
         _for_stmt->prepare(ctx);
     }
 
+    void fold() override {
+        _expr.fold();
+        _for_stmt->fold();
+    }
+
+    void collect_refs(ReferenceSink& refs) override {
+        _expr.collect_refs(refs);
+        _for_stmt->collect_refs(refs);
+    }
+
+    void serialize(UnitWriter& out) override {
+        out.u8(UnitWriter::foreach_tag);
+        out.expr(_expr.node());
+        out.symbol(_var_name);
+        out.ast(_for_stmt);
+    }
+
     void debug_string(std::stringstream& out, const std::string& prefix) override {
-        out << prefix << counter() << "for each " << _var_name << " : " << _expr.expr_name()
+        out << prefix << counter() << "for each " << symbol_name(_var_name) << " : "
+            << _expr.expr_name()
             << "\n";
 
         _for_stmt->debug_string(out, prefix + "\t");
@@ -215,7 +344,7 @@ struct ForeachNode : AstNode {
 
 private:
     Expr _expr;
-    std::string _var_name;
+    SymbolId _var_name;
     StmtNode* _for_stmt;
 };
 
@@ -228,15 +357,35 @@ struct FuncNode : AstNode {
     }
     void set_stmt(StmtNode* stmt) { _stmt = stmt; }
 
+    // lazy mode: only the offset just past '{' is known until the first call
+    bool is_lazy() const { return _stmt == nullptr; }
+    void set_lazy_body(size_t offset) { _body_offset = offset; }
+    // parses, folds and prepares the body from the unit's source, exits on a parse error
+    void compile(CompileUnit* unit, GlobalContext* global);
+
     void debug_string(std::stringstream& out, const std::string& prefix) override {
         out << prefix << counter() << "func " << _func_name << "\n";
-        _stmt->debug_string(out, prefix + "\t");
+        if (_stmt) _stmt->debug_string(out, prefix + "\t");
     }
 
-    void prepare(Context* ctx) override { _stmt->prepare(ctx); }
+    void prepare(Context* ctx) override {
+        if (_stmt) _stmt->prepare(ctx);
+    }
+    void fold() override {
+        if (_stmt) _stmt->fold();
+    }
+    void collect_refs(ReferenceSink& refs) override {
+        if (_stmt) _stmt->collect_refs(refs);
+    }
+    // only the body, the name and parameters are written with the unit's function table
+    void serialize(UnitWriter& out) override {
+        if (!_stmt) return out.fail();
+        out.ast(_stmt);
+    }
 
 private:
-    StmtNode* _stmt;
+    StmtNode* _stmt = nullptr;
+    size_t _body_offset = 0;
     std::string _func_name;
 };
 
@@ -0,0 +1,77 @@
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Arena.h"
+#include "SourceFile.h"
+#include "Symbol.h"
+#include "Value.h"
+
+struct FuncNode;
+
+// everything parsed out of one source file. a unit only touches its own arena and the
+// symbol table while parsing, so units can be built on any thread and are merged into the
+// GlobalContext afterwards in a fixed order.
+struct CompileUnit {
+    struct FuncDecl {
+        SymbolId name;
+        std::vector<SymbolId> args_name;
+        FuncNode* node;
+    };
+
+    struct StructMember {
+        SymbolId name;
+        Value value;
+        // "member = struct X;" is resolved against the struct table when the unit is merged
+        SymbolId struct_name = SymbolTable::invalid_id;
+    };
+
+    struct StructDecl {
+        SymbolId name;
+        SymbolId base = SymbolTable::invalid_id;
+        std::vector<StructMember> members;
+    };
+
+    CompileUnit(std::filesystem::path path) : _path(std::move(path)) {}
+    CompileUnit(CompileUnit&&) = default;
+
+    const auto& path() const { return _path; }
+    auto* arena() { return &_arena; }
+
+    // lazy mode: the unit keeps its source mapped, function bodies are parsed from it on the
+    // first call
+    bool lazy() const { return _source.has_value(); }
+    void keep_source(SourceFile source) { _source.emplace(std::move(source)); }
+    std::string_view source() const { return _source->text(); }
+
+    // content hash of the source the unit was built from
+    uint64_t source_hash() const { return _source_hash; }
+    void set_source_hash(uint64_t hash) { _source_hash = hash; }
+
+    void add_func(SymbolId name, std::vector<SymbolId> args_name, FuncNode* node) {
+        _funcs.push_back({name, std::move(args_name), node});
+    }
+    void add_struct(StructDecl decl) { _structs.push_back(std::move(decl)); }
+
+    const auto& funcs() const { return _funcs; }
+    const auto& structs() const { return _structs; }
+
+    // set when the file could not be read or parsed, "file:line:col: msg"
+    bool failed() const { return !_error.empty(); }
+    const std::string& error() const { return _error; }
+    void set_error(std::string error) { _error = std::move(error); }
+
+private:
+    friend struct GlobalContext;
+    std::filesystem::path _path;
+    std::string _error;
+    uint64_t _source_hash = 0;
+    std::optional<SourceFile> _source;
+    // set by the GlobalContext, unique for every unit merged during the run
+    uint64_t _serial = 0;
+    Arena _arena;
+    std::vector<FuncDecl> _funcs;
+    std::vector<StructDecl> _structs;
+};
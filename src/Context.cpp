@@ -1,16 +1,357 @@
 #include "Context.h"
 
+#include <unordered_set>
+
 #include "Ast.h"
 #include "ExprBuild.h"
 #include "Function.h"
+#include "ThreadPool.h"
+#include "UnitCache.h"
+
+namespace {
+FunctionSignature signature_of(const CompileUnit::FuncDecl& func) {
+    return {func.name, int(func.args_name.size())};
+}
+
+// the first definition wins inside a unit as well
+const CompileUnit::FuncDecl* find_decl(const CompileUnit& unit, FunctionSignature signature) {
+    for (auto& func : unit.funcs()) {
+        if (signature_of(func) == signature) return &func;
+    }
+    return nullptr;
+}
+
+bool path_less(const CompileUnit* l, const CompileUnit* r) {
+    return l->path() < r->path();
+}
+} // namespace
 
 GlobalContext::GlobalContext() {
     _function_mgr = std::make_unique<FunctionMgr>();
     _struct_mgr = std::make_unique<StructInfoMgr>();
 }
 
-void GlobalContext::prepare(Context* ctx) {
-    for (auto* func : _func_nodes) {
-        func->prepare(ctx);
+void GlobalContext::merge(CompileUnit&& unit) {
+    auto owned = std::make_unique<CompileUnit>(std::move(unit));
+    owned->_serial = _next_serial++;
+    for (auto& func : owned->funcs()) {
+        _function_mgr->register_func(func.name, func.args_name, func.node, owned.get());
+        auto& definitions = _definitions[signature_of(func)];
+        if (definitions.empty() || definitions.back() != owned.get()) {
+            definitions.push_back(owned.get());
+        }
+    }
+    auto error = apply_structs(*owned, _struct_mgr.get());
+    CHECK(error.empty(), error);
+    _units.emplace(owned->path(), std::move(owned));
+}
+
+PruneReport GlobalContext::prune(FunctionSignature entry) {
+    PruneReport report;
+    for (auto& [_, unit] : _units) report.bytes_before += unit->arena()->used_bytes();
+    report.bytes_after = report.bytes_before;
+    if (!std::dynamic_pointer_cast<DefFunction>(_function_mgr->find_func(entry))) return report;
+
+    // only the bound definition of a signature is reachable, later ones are never called
+    std::unordered_set<FunctionSignature, FunctionSignatureHash> seen {entry};
+    std::vector<FunctionSignature> pending {entry};
+    std::unordered_set<FuncNode*> live;
+    ReferenceSink refs;
+    while (!pending.empty()) {
+        auto func = std::dynamic_pointer_cast<DefFunction>(_function_mgr->find_func(pending.back()));
+        pending.pop_back();
+        // built in, or missing and reported by prepare
+        if (!func) continue;
+        live.insert(func->_funcnode);
+        refs.calls.clear();
+        func->_funcnode->collect_refs(refs);
+        for (auto call : refs.calls) {
+            if (seen.insert(call).second) pending.push_back(call);
+        }
+    }
+    report.kept_funcs = live.size();
+
+    for (auto& [path, unit] : _units) {
+        auto file_name = path.filename().string();
+        std::vector<CompileUnit::FuncDecl> kept;
+        std::vector<FunctionSignature> removed;
+        for (auto& func : unit->_funcs) {
+            if (live.contains(func.node)) {
+                kept.push_back(std::move(func));
+                continue;
+            }
+            auto signature = signature_of(func);
+            auto bound = std::dynamic_pointer_cast<DefFunction>(_function_mgr->find_func(signature));
+            if (bound && bound->_funcnode == func.node) _function_mgr->set_func(signature, nullptr);
+            report.removed_funcs.emplace_back(file_name, signature);
+            removed.push_back(signature);
+        }
+        if (removed.empty()) continue;
+        unit->_funcs = std::move(kept);
+        for (auto signature : removed) {
+            if (find_decl(*unit, signature)) continue;
+            auto& definitions = _definitions[signature];
+            std::erase(definitions, unit.get());
+            if (definitions.empty()) _definitions.erase(signature);
+        }
+        compact(*unit);
+    }
+
+    // prototypes are copied into the structs using them, only let needs the table entry
+    std::unordered_set<SymbolId> used(refs.structs.begin(), refs.structs.end());
+    for (auto& [_, unit] : _units) {
+        for (auto& decl : unit->structs()) {
+            if (used.contains(decl.name) || !_struct_mgr->contains(decl.name)) continue;
+            _struct_mgr->erase(decl.name);
+            report.removed_structs.push_back(decl.name);
+        }
+    }
+
+    report.bytes_after = 0;
+    for (auto& [_, unit] : _units) report.bytes_after += unit->arena()->used_bytes();
+    return report;
+}
+
+void GlobalContext::prepare(ThreadPool* pool) {
+    std::vector<std::pair<CompileUnit*, FuncNode*>> funcs;
+    for (auto& [_, unit] : _units) {
+        for (auto& func : unit->funcs()) funcs.emplace_back(unit.get(), func.node);
+    }
+    std::vector<CallSiteSink> sinks(_track_call_sites ? funcs.size() : 0);
+    // preparing only looks functions up, bodies do not share any state
+    pool->parallel_for(funcs.size(), [&](size_t i) {
+        Context ctx {this};
+        if (_track_call_sites) ctx.set_call_sink(&sinks[i]);
+        funcs[i].second->prepare(&ctx);
+    });
+    for (size_t i = 0; i < sinks.size(); i++) {
+        add_call_sites(*funcs[i].first, sinks[i].call_sites);
+    }
+}
+
+bool GlobalContext::reload(CompileUnit&& unit, ReloadReport* report) {
+    CHECK(_track_call_sites, "reload needs the call sites, see track_call_sites()");
+    auto owned = std::make_unique<CompileUnit>(std::move(unit));
+    owned->_serial = _next_serial++;
+    auto old_it = _units.find(owned->path());
+    CompileUnit* old = old_it == _units.end() ? nullptr : old_it->second.get();
+
+    // structs are few, the table is simply rebuilt with the new unit in place
+    auto structs = std::make_unique<StructInfoMgr>();
+    for (auto* each : ordered_units(owned.get())) {
+        report->error = apply_structs(*each, structs.get());
+        if (!report->error.empty()) return false;
+    }
+
+    // definitions of every signature the old or the new unit defines, after the swap
+    std::unordered_map<FunctionSignature, std::vector<CompileUnit*>, FunctionSignatureHash>
+            definitions;
+    for (auto* each : {old, owned.get()}) {
+        if (each == nullptr) continue;
+        for (auto& func : each->funcs()) {
+            auto signature = signature_of(func);
+            if (definitions.contains(signature)) continue;
+            auto& defs = definitions[signature];
+            if (auto it = _definitions.find(signature); it != _definitions.end()) {
+                defs = it->second;
+            }
+            std::erase(defs, old);
+            if (find_decl(*owned, signature)) {
+                defs.insert(std::lower_bound(defs.begin(), defs.end(), owned.get(), path_less),
+                            owned.get());
+            }
+        }
+    }
+
+    // signatures whose bound definition changes, applied to the function table for now so
+    // the new unit prepares against it
+    struct Change {
+        FunctionSignature signature;
+        std::shared_ptr<Function> func;
+        std::shared_ptr<Function> previous;
+    };
+    std::vector<Change> changes;
+    for (auto& [signature, defs] : definitions) {
+        auto* winner = defs.empty() ? nullptr : defs.front();
+        auto it = _definitions.find(signature);
+        auto* old_winner = it == _definitions.end() ? nullptr : it->second.front();
+        if (winner == old_winner) continue;
+        std::shared_ptr<Function> func;
+        if (winner) {
+            auto* decl = find_decl(*winner, signature);
+            func = std::make_shared<DefFunction>(decl->node, decl->args_name, signature,
+                                                 winner);
+        } else {
+            // a removed function that shadowed a builtin leaves the builtin in its place
+            func = _function_mgr->find_built_in(signature);
+        }
+        changes.push_back({signature, func, _function_mgr->find_func(signature)});
+        _function_mgr->set_func(signature, func);
+    }
+
+    CallSiteSink sink;
+    sink.allow_missing = true;
+    Context ctx {this};
+    ctx.set_call_sink(&sink);
+    for (auto& func : owned->funcs()) {
+        func.node->prepare(&ctx);
     }
-}
\ No newline at end of file
+
+    if (!sink.missing.empty()) {
+        report->error = "can not find funciton name " + symbol_name(sink.missing[0].first);
+    }
+    for (auto& change : changes) {
+        if (change.func) continue;
+        auto it = _call_sites.find(change.signature);
+        if (it == _call_sites.end()) continue;
+        for (auto& site : it->second) {
+            if (!old || site.unit_serial != old->_serial) {
+                report->error = "function " + symbol_name(change.signature.first) +
+                                " is removed but still called";
+                break;
+            }
+        }
+    }
+    if (!report->error.empty()) {
+        for (auto& change : changes) {
+            _function_mgr->set_func(change.signature, change.previous);
+        }
+        return false;
+    }
+
+    // commit
+    for (auto& [signature, defs] : definitions) {
+        if (defs.empty()) {
+            _definitions.erase(signature);
+        } else {
+            _definitions[signature] = std::move(defs);
+        }
+    }
+    if (old) {
+        for (auto signature : _unit_calls[old->_serial]) {
+            auto& sites = _call_sites[signature];
+            std::erase_if(sites, [&](const CallSite& site) {
+                return site.unit_serial == old->_serial;
+            });
+        }
+        _unit_calls.erase(old->_serial);
+    }
+    add_call_sites(*owned, sink.call_sites);
+    for (auto& change : changes) {
+        if (change.func) report->rebound_calls += rebind(change.signature, change.func);
+    }
+    report->replaced_funcs = changes.size();
+    _struct_mgr = std::move(structs);
+    // frees the old unit's nodes
+    _units[owned->path()] = std::move(owned);
+    return true;
+}
+
+const CompileUnit* GlobalContext::unit(const std::filesystem::path& path) const {
+    auto it = _units.find(path);
+    return it == _units.end() ? nullptr : it->second.get();
+}
+
+std::vector<FuncNode*> GlobalContext::func_nodes() const {
+    std::vector<FuncNode*> nodes;
+    for (auto& [_, unit] : _units) {
+        for (auto& func : unit->funcs()) nodes.push_back(func.node);
+    }
+    return nodes;
+}
+
+std::vector<CompileUnit*> GlobalContext::ordered_units(CompileUnit* replacement) const {
+    std::vector<CompileUnit*> units;
+    bool placed = false;
+    for (auto& [path, unit] : _units) {
+        if (!placed && !(path < replacement->path())) {
+            units.push_back(replacement);
+            placed = true;
+            if (path == replacement->path()) continue;
+        }
+        units.push_back(unit.get());
+    }
+    if (!placed) units.push_back(replacement);
+    return units;
+}
+
+std::string GlobalContext::apply_structs(const CompileUnit& unit, StructInfoMgr* structs) {
+    auto missing = [](SymbolId name) { return " can not find struct name : " + symbol_name(name); };
+    for (auto& decl : unit.structs()) {
+        if (decl.base != SymbolTable::invalid_id) {
+            if (!structs->contains(decl.base)) return missing(decl.base);
+            structs->extends(decl.name, decl.base);
+        }
+        StructMembers members;
+        for (auto& member : decl.members) {
+            if (member.struct_name == SymbolTable::invalid_id) {
+                members[member.name] = member.value;
+            } else if (structs->contains(member.struct_name)) {
+                members[member.name] = structs->get_default_struct_value(member.struct_name);
+            } else {
+                return missing(member.struct_name);
+            }
+        }
+        structs->put_struct_info(decl.name, members);
+    }
+    return "";
+}
+
+void GlobalContext::compact(CompileUnit& unit) {
+    if (unit._funcs.empty()) {
+        unit.arena()->clear();
+        return;
+    }
+    // the unit cache encoding already copies a folded tree, written and read back in memory
+    UnitWriter out;
+    for (auto& func : unit._funcs) out.ast(func.node);
+    if (!out.ok()) return;
+    auto bytes = out.finish(0);
+    Arena arena;
+    UnitReader in(bytes, &arena);
+    in.read_header(0);
+    std::vector<FuncNode*> nodes;
+    for (auto& func : unit._funcs) {
+        nodes.push_back(arena.create<FuncNode>(symbol_name(func.name)));
+        nodes.back()->set_stmt(in.stmt());
+    }
+    if (in.failed()) return;
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        auto& func = unit._funcs[i];
+        auto signature = signature_of(func);
+        auto bound = std::dynamic_pointer_cast<DefFunction>(_function_mgr->find_func(signature));
+        if (bound && bound->_funcnode == func.node) {
+            _function_mgr->set_func(signature, std::make_shared<DefFunction>(
+                                                       nodes[i], func.args_name, signature, &unit));
+        }
+        func.node = nodes[i];
+    }
+    unit.arena()->clear();
+    unit.arena()->acquire_data(&arena);
+}
+
+void GlobalContext::add_call_sites(const CompileUnit& unit,
+                                   const std::vector<FuncCallOperator*>& sites) {
+    auto& called = _unit_calls[unit._serial];
+    for (auto* site : sites) {
+        auto& entries = _call_sites[site->_signature];
+        if (entries.empty() || entries.back().unit_serial != unit._serial) {
+            called.push_back(site->_signature);
+        }
+        entries.push_back({site, unit._serial});
+    }
+    std::sort(called.begin(), called.end());
+    called.erase(std::unique(called.begin(), called.end()), called.end());
+}
+
+size_t GlobalContext::rebind(FunctionSignature signature, const std::shared_ptr<Function>& func) {
+    size_t rebound = 0;
+    for (auto& site : _call_sites[signature]) {
+        if (site.node->_func_ptr != func) {
+            site.node->_func_ptr = func;
+            rebound++;
+        }
+    }
+    return rebound;
+}
@@ -1,10 +1,47 @@
 #pragma once
+#include <unordered_map>
+
+#include "Arena.h"
+#include "CompileUnit.h"
 #include "Function.h"
 #include "Variable.h"
 #include "util.h"
 
 struct ExprNode;
 struct FuncNode;
+struct FuncCallOperator;
+struct ThreadPool;
+
+// receives what FuncCallOperator::prepare binds while a unit is prepared
+struct CallSiteSink {
+    std::vector<FuncCallOperator*> call_sites;
+    // with allow_missing, unresolved calls are listed here instead of stopping the program
+    bool allow_missing = false;
+    std::vector<FunctionSignature> missing;
+};
+
+// receives what collect_refs finds in a function body
+struct ReferenceSink {
+    std::vector<FunctionSignature> calls;
+    // structs created with let
+    std::vector<SymbolId> structs;
+};
+
+struct PruneReport {
+    size_t kept_funcs = 0;
+    // the file and signature of every dropped definition
+    std::vector<std::pair<std::string, FunctionSignature>> removed_funcs;
+    std::vector<SymbolId> removed_structs;
+    // node memory of all units before and after
+    size_t bytes_before = 0;
+    size_t bytes_after = 0;
+};
+
+struct ReloadReport {
+    size_t replaced_funcs = 0;
+    size_t rebound_calls = 0;
+    std::string error;
+};
 
 
 struct FunctionContext {
@@ -19,28 +56,74 @@ private:
 };
 struct GlobalContext {
     GlobalContext();
-    void prepare(Context* ctx);
+    // takes over the unit and registers its functions and structs. units are merged in path
+    // order: the first definition of a function signature wins and structs can only use
+    // structs merged before them.
+    void merge(CompileUnit&& unit);
+    // drops every function and struct prototype that entry can not reach, before prepare.
+    // units with dropped functions are compacted into a fresh arena. nothing is dropped when
+    // there is no entry function.
+    PruneReport prune(FunctionSignature entry);
+    // prepares every function body, spread over the pool
+    void prepare(ThreadPool* pool);
+
+    // remember every call site by its target, needed by reload
+    void track_call_sites() { _track_call_sites = true; }
+
+    // hot reload: replaces the unit with the same path, or adds it. the unit is prepared on
+    // its own and only calls whose target changed are rebound, everything else keeps its
+    // prepared tree. nothing changes when the new unit does not fit, see report.error.
+    bool reload(CompileUnit&& unit, ReloadReport* report);
+
+    const CompileUnit* unit(const std::filesystem::path& path) const;
+    std::vector<FuncNode*> func_nodes() const;
+
 private:
     friend class Context;
-    ObjectPool _obj_pool;
+
+    struct CallSite {
+        FuncCallOperator* node;
+        // the unit owning the node, its sites are dropped when it is replaced
+        uint64_t unit_serial;
+    };
+
+    // the units in path order; the struct table is rebuilt from them on reload
+    std::vector<CompileUnit*> ordered_units(CompileUnit* replacement) const;
+    static std::string apply_structs(const CompileUnit& unit, StructInfoMgr* structs);
+    // rewrites the unit's remaining functions into a fresh arena, freeing the dropped ones
+    void compact(CompileUnit& unit);
+    void add_call_sites(const CompileUnit& unit, const std::vector<FuncCallOperator*>& sites);
+    size_t rebind(FunctionSignature signature, const std::shared_ptr<Function>& func);
+
+    // the units own every ast and expression node
+    std::map<std::filesystem::path, std::unique_ptr<CompileUnit>> _units;
+    uint64_t _next_serial = 1;
+    // every user definition of a signature, in path order; the first one is bound
+    std::unordered_map<FunctionSignature, std::vector<CompileUnit*>, FunctionSignatureHash>
+            _definitions;
+    bool _track_call_sites = false;
+    std::unordered_map<FunctionSignature, std::vector<CallSite>, FunctionSignatureHash>
+            _call_sites;
+    // signatures each unit calls, by unit serial
+    std::unordered_map<uint64_t, std::vector<FunctionSignature>> _unit_calls;
+
     std::vector<FunctionContext> _func_stack;
     std::unique_ptr<FunctionMgr> _function_mgr;
     std::unique_ptr<StructInfoMgr> _struct_mgr;
-    std::vector<FuncNode*> _func_nodes;
 };
 
 struct Context {
 public:
-    Context(GlobalContext* global) : _global(global) {}
+    Context(GlobalContext* global, CompileUnit* unit = nullptr) : _global(global), _unit(unit) {}
 
     auto global() const { return _global; }
     auto* func() { return &global()->_func_stack.back(); }
 
 
     // function level
-    VariableMgr* variable_mgr(const std::string& name) { return func()->variable_mgr(); }
+    VariableMgr* variable_mgr(SymbolId name) { return func()->variable_mgr(); }
 
-    ReferenceWrapping& variable_ref(const std::string& name) {
+    ReferenceWrapping& variable_ref(SymbolId name) {
         return func()->variable_mgr()->get_ref(name);
     }
 
@@ -49,13 +132,17 @@ public:
     void push_func(const std::string& name) { global()->_func_stack.emplace_back(name); }
     void pop_func() { global()->_func_stack.pop_back(); }
 
-    auto* obj_pool() { return &global()->_obj_pool; }
+    // parse time only: the unit being built and the arena its nodes go to
+    auto* unit() { return _unit; }
+    auto* arena() { return _unit->arena(); }
 
     auto* func_mgr() { return global()->_function_mgr.get(); }
 
-    void add_func_node(FuncNode* func_node) { global()->_func_nodes.push_back(func_node); }
+    std::vector<FuncNode*> all_func_node() { return global()->func_nodes(); }
 
-    std::vector<FuncNode*> all_func_node() { return global()->_func_nodes; }
+    // null unless the calls being prepared are recorded
+    auto* call_sink() { return _call_sink; }
+    void set_call_sink(CallSiteSink* sink) { _call_sink = sink; }
 
     auto* struct_info() const { return global()->_struct_mgr.get(); }
 
@@ -66,6 +153,8 @@ public:
 
 private:
     GlobalContext* _global;
+    CompileUnit* _unit;
+    CallSiteSink* _call_sink = nullptr;
 
     Value _ret = Value::default_value;
 
@@ -3,6 +3,7 @@
 #include <vector>
 
 #include "Context.h"
+#include "Map.h"
 #include "Value.h"
 
 void VariableNode::create_reference_wrapping(Context* ctx) {
@@ -23,17 +24,71 @@ ReferenceWrapping& VariableNode::ref(Context* ctx) {
     return ctx->variable_ref(_name);
 }
 
+void AssignOperator::prepare(Context* ctx) {
+    ExprNode::prepare(ctx);
+    auto* member = dynamic_cast<MemberAccessOperator*>(Lchild());
+    _element = dynamic_cast<SubscriptOperator*>(Lchild()) || (member && member->on_element());
+    // the target must be a plain variable and the leftmost operand of a chain of +
+    _append = false;
+    auto* target = dynamic_cast<VariableNode*>(Lchild());
+    if (!target || target->Opnums() != 0) return;
+    ExprNode* node = Rchild();
+    while (auto* add = dynamic_cast<AddOperator*>(node)) {
+        if (add->is_constant()) return;
+        node = add->Lchild();
+        auto* base = dynamic_cast<VariableNode*>(node);
+        if (base && base->Opnums() == 0 && base->symbol() == target->symbol()) {
+            _append = true;
+            return;
+        }
+    }
+}
+
+Value* AssignOperator::append_chain(ExprNode* node, Context* ctx, Value& sum) {
+    if (node->Opnums() == 0) {
+        auto& target = Lchild()->get_variable(ctx).deref();
+        if (target.is_str()) return &target;
+        sum = target;
+        return nullptr;
+    }
+    // the order BinaryOperator::exec runs operands in: right first, so the target is read last
+    auto* add = static_cast<AddOperator*>(node);
+    // a ref operand is read now, it may point at the target
+    Value value = add->Rchild()->exec(ctx).deref();
+    auto* target = append_chain(add->Lchild(), ctx, sum);
+    if (!target) {
+        sum = ValueOp::Add(sum, value);
+        return nullptr;
+    }
+    CHECK(value.is_str() || value.is_number(), "should not reach here.");
+    target->append_string(value);
+    return target;
+}
+
 void FuncCallOperator::prepare(Context* ctx) {
     ExprNode::prepare(ctx);
-    _func_ptr = ctx->func_mgr()->get_func(_signature);
+    auto* sink = ctx->call_sink();
+    if (sink && sink->allow_missing) {
+        _func_ptr = ctx->func_mgr()->find_func(_signature);
+        if (!_func_ptr) sink->missing.push_back(_signature);
+    } else {
+        _func_ptr = ctx->func_mgr()->get_func(_signature);
+    }
+    if (sink) sink->call_sites.push_back(this);
+}
+
+void FuncCallOperator::collect_refs(ReferenceSink& refs) {
+    ExprNode::collect_refs(refs);
+    refs.calls.push_back(_signature);
 }
 
 Value FuncCallOperator::exec(Context* ctx) {
     std::vector<Value> args;
+    args.reserve(_child.size());
     for (auto& arg : _child) {
         args.push_back(arg->exec(ctx));
     }
-    return _func_ptr->exce(ctx, args);
+    return _func_ptr->exce(ctx, std::move(args));
 }
 
 Value RefOperator::exec(Context* ctx) {
@@ -44,35 +99,181 @@ Value RefOperator::exec(Context* ctx) {
 }
 
 Value ArrOperator::exec(Context* ctx) {
-    std::vector<Value> arr(child(0)->exec(ctx).get_int());
-    return Value::make_Arr(arr);
+    auto size = child(0)->exec(ctx).get_int();
+    if (_kind == Array::Kind::Columns) {
+        auto element = ctx->struct_info()->get_default_struct_value(_struct);
+        return Value::make_Arr(Array::filled(size, element));
+    }
+    return Value::make_Arr(Array(size, _kind));
+}
+
+std::string ArrOperator::name() const {
+    if (_kind == Array::Kind::Int) return "Arr " + _child[0]->name();
+    auto element = _kind == Array::Kind::Columns ? symbol_name(_struct) : type_to_str(Type(_kind));
+    return "Arr " + element + " " + _child[0]->name();
+}
+
+void ArrOperator::collect_refs(ReferenceSink& refs) {
+    ExprNode::collect_refs(refs);
+    if (_kind == Array::Kind::Columns) refs.structs.push_back(_struct);
+}
+
+void ArrOperator::serialize(UnitWriter& out) {
+    if (_kind == Array::Kind::Int) return out.op(OpKind::Arr, _child);
+    out.u8(UnitWriter::typed_arr_tag);
+    out.u8(uint8_t(_kind));
+    if (_kind == Array::Kind::Columns) out.symbol(_struct);
+    out.expr(child(0));
+}
+
+void StructOperator::collect_refs(ReferenceSink& refs) {
+    if (child(0)->is_variable()) {
+        refs.structs.push_back(static_cast<VariableNode*>(child(0))->symbol());
+    }
 }
 
 Value StructOperator::exec(Context* ctx) {
     CHECK(child(0)->is_variable(), " struct name ");
-    auto struct_name = child(0)->name();
+    auto struct_name = static_cast<VariableNode*>(child(0))->symbol();
     return ctx->struct_info()->get_default_struct_value(struct_name);
 }
 
 Value SubscriptOperator::exec(Context* ctx) {
-    return get_variable(ctx);
+    auto [var, i] = locate(ctx);
+    if (i == in_map) return var;
+    return var.get_array().get(i);
 }
 
 Value& SubscriptOperator::get_variable(Context* ctx) {
+    size_t i;
+    Value* element;
+    auto* arr = locate_for_write(ctx, i, element);
+    return arr ? arr->slot(i) : *element;
+}
+
+void SubscriptOperator::assign(Context* ctx, const Value& v) {
+    size_t i;
+    Value* element;
+    if (auto* arr = locate_for_write(ctx, i, element)) return arr->set(i, v);
+    *element = v;
+}
+
+std::pair<Value, size_t> SubscriptOperator::locate(Context* ctx) {
+    CHECK(_child.size() == 2, "[] must only one child");
+    CHECK(child(0)->is_variable(), "[] must be use in variable");
+    auto var = child(0)->exec(ctx);
+    auto idx = child(1)->exec(ctx);
+    if (var.deref().is_map()) {
+        auto& key = idx.deref();
+        auto* element = var.get_map().find(key);
+        CHECK(element, "key " + key.to_string() + " is not in the map");
+        return {*element, in_map};
+    }
+    auto i = Value::checked_index(var.get_array(), idx);
+    return {std::move(var), i};
+}
+
+Array* SubscriptOperator::locate_for_write(Context* ctx, size_t& i, Value*& element) {
     CHECK(_child.size() == 2, "[] must only one child");
     CHECK(child(0)->is_variable(), "[] must be use in variable");
     Value& var = child(0)->get_variable(ctx);
-    return var[child(1)->exec(ctx)];
+    auto idx = child(1)->exec(ctx);
+    if (var.deref().is_map()) {
+        element = &var.write_map()[idx.deref()];
+        return nullptr;
+    }
+    auto& arr = var.write_array();
+    i = Value::checked_index(arr, idx);
+    return &arr;
 }
 
-Value MemberAccessOperator::exec(Context* ctx) {
-    return get_variable(ctx);
+Value SliceOperator::exec(Context* ctx) {
+    auto arr = child(0)->exec(ctx);
+    auto lo = child(1)->exec(ctx).get_int();
+    auto hi = _has_hi ? child(2)->exec(ctx).get_int() : int64_t(arr.get_array().size());
+    return arr.slice(lo, hi);
 }
 
-Value& MemberAccessOperator::get_variable(Context* ctx) {
+std::string SliceOperator::name() const {
+    auto hi = _has_hi ? _child[2]->name() : "";
+    return _child[0]->name() + "[" + _child[1]->name() + ":" + hi + "]";
+}
+
+void SliceOperator::serialize(UnitWriter& out) {
+    out.u8(UnitWriter::slice_tag);
+    out.u8(_has_hi);
+    for (auto* child : _child) out.expr(child);
+}
+
+namespace {
+// whether evaluating node can change anything: a call or an assignment somewhere in it
+bool has_effects(ExprNode* node) {
+    if (dynamic_cast<FuncCallOperator*>(node) || dynamic_cast<AssignOperator*>(node)) return true;
+    for (auto* child : node->_child) {
+        if (has_effects(child)) return true;
+    }
+    return false;
+}
+} // namespace
+
+void MemberAccessOperator::prepare(Context* ctx) {
+    VariableNode::prepare(ctx);
+    _element = dynamic_cast<SubscriptOperator*>(child(0));
+    _write_only = has_effects(child(0));
+}
+
+SymbolId MemberAccessOperator::member_name() {
     CHECK(_child.size() == 2, "[] must only one child");
     CHECK(child(0)->is_variable(), " var.var ");
     CHECK(child(1)->is_variable(), " var.var ");
-    Value& var = child(0)->get_variable(ctx);
-    return var[child(1)->name()];
-}
\ No newline at end of file
+    return static_cast<VariableNode*>(child(1))->symbol();
+}
+
+Value MemberAccessOperator::exec(Context* ctx) {
+    // a missing member is added by the write path, which evaluates the object again. that is
+    // harmless for names and plain subscripts, an object with a call in it takes the write
+    // path right away so the call runs once.
+    if (_write_only) return get_variable(ctx);
+    auto name = member_name();
+    // a read leaves a shared struct shared, only a missing member takes the write path
+    if (_element) {
+        auto [var, i] = _element->locate(ctx);
+        if (i != SubscriptOperator::in_map) {
+            auto& items = var.get_array();
+            if (auto* column = items.column(name, _cache)) return column->get(i);
+            var = items.get(i);
+        }
+        if (auto* member = var.find_member(name, _cache)) return *member;
+        return get_variable(ctx);
+    }
+    auto var = child(0)->exec(ctx);
+    if (auto* member = var.find_member(name, _cache)) return *member;
+    return get_variable(ctx);
+}
+
+Value& MemberAccessOperator::get_variable(Context* ctx) {
+    auto name = member_name();
+    if (_element) {
+        // a reference into a column boxes that column only
+        size_t i;
+        Value* element;
+        auto* items = _element->locate_for_write(ctx, i, element);
+        if (!items) return element->member(name, _cache);
+        if (auto* column = items->column(name, _cache)) return column->slot(i);
+        return items->slot(i).member(name, _cache);
+    }
+    return child(0)->get_variable(ctx).member(name, _cache);
+}
+
+void MemberAccessOperator::assign(Context* ctx, const Value& v) {
+    auto name = member_name();
+    if (_element) {
+        size_t i;
+        Value* element;
+        auto* items = _element->locate_for_write(ctx, i, element);
+        if (!items) return element->member(name, _cache).assign_value(v);
+        if (auto* column = items->column(name, _cache)) return column->set(i, v);
+        return items->slot(i).member(name, _cache).assign_value(v);
+    }
+    child(0)->get_variable(ctx).member(name, _cache).assign_value(v);
+}
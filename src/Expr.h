@@ -1,18 +1,26 @@
 #pragma once
+#include <span>
+
+#include "Arena.h"
 #include "Function.h"
+#include "UnitCache.h"
 #include "Value.h"
 #include "Variable.h"
 #include "util.h"
 struct Context;
+struct ReferenceSink;
 
+// nodes live in the program's Arena, children are an arena-backed span of raw pointers
 struct ExprNode {
     virtual Value exec(Context*) = 0;
     ExprNode* child(int id) const {
-        CHECK(id < _child.size(), "out of bound");
-        return _child[id].get();
+        CHECK(size_t(id) < _child.size(), "out of bound");
+        return _child[id];
+    }
+    void set_children(Arena* arena, std::span<ExprNode* const> children) {
+        _child = arena->copy_array<ExprNode*>(children);
     }
-    void add_child(std::unique_ptr<ExprNode> node) { _child.push_back(std::move(node)); }
-    std::vector<std::unique_ptr<ExprNode>> _child;
+    std::span<ExprNode*> _child;
     virtual ~ExprNode() = default;
     virtual int Opnums() = 0;
     virtual Value& get_variable(Context* ctx) {
@@ -22,13 +30,25 @@ struct ExprNode {
     virtual bool is_variable() { return false; }
     virtual bool is_constant() { return false; }
     virtual void prepare(Context* ctx) {
-        CHECK(_child.size() == Opnums(), "child size can not macth " +
-                                                 std::to_string(_child.size()) + " vs " +
-                                                 std::to_string(Opnums()));
+        CHECK(_child.size() == size_t(Opnums()), "child size can not macth " +
+                                                         std::to_string(_child.size()) + " vs " +
+                                                         std::to_string(Opnums()));
         for (auto& child : _child) {
             child->prepare(ctx);
         }
     }
+    // constant folding, needs nothing outside the tree so it runs right after parsing
+    virtual void fold() {
+        for (auto& child : _child) {
+            child->fold();
+        }
+    }
+    virtual void collect_refs(ReferenceSink& refs) {
+        for (auto* child : _child) {
+            child->collect_refs(refs);
+        }
+    }
+    virtual void serialize(UnitWriter& out) { out.fail(); }
     virtual std::string name() const = 0;
 };
 
@@ -42,6 +62,11 @@ struct ConstantValueNode : ExprNode {
 
     Value exec(Context*) override { return _value; }
 
+    void serialize(UnitWriter& out) override {
+        out.u8(UnitWriter::constant_tag);
+        out.value(_value);
+    }
+
     Value _value;
 
     int Opnums() override { return 0; }
@@ -57,7 +82,12 @@ struct BinaryOperator : ExprNode {
         if (_fold) {
             return _fold_value;
         }
-        return BinaryOp::op(Lchild()->exec(ctx), Rchild()->exec(ctx));
+        // the right operand first, then the left one: the order gcc gave the two calls as
+        // arguments of op, kept so scripts with side effects in operands print the same.
+        // AssignOperator::append_chain relies on it.
+        Value rhs = Rchild()->exec(ctx);
+        Value lhs = Lchild()->exec(ctx);
+        return BinaryOp::op(lhs, rhs);
     }
 
     ExprNode* Lchild() const { return child(0); }
@@ -76,11 +106,27 @@ struct BinaryOperator : ExprNode {
     bool is_constant() override { return _fold; }
 
     void prepare(Context* ctx) override {
-        ExprNode::prepare(ctx);
+        if (!_fold) ExprNode::prepare(ctx);
+    }
+
+    void fold() override {
+        ExprNode::fold();
         if (Lchild()->is_constant() && Rchild()->is_constant()) {
-            _fold_value = BinaryOp::op(Lchild()->exec(ctx), Rchild()->exec(ctx));
+            _fold_value = BinaryOp::op(Lchild()->exec(nullptr), Rchild()->exec(nullptr));
+            // a folded string is a constant like any literal
+            if (_fold_value.is_str()) _fold_value = Value::make_Interned(_fold_value.as_string());
             _fold = true;
-            _child.clear();
+            _child = {};
+        }
+    }
+
+    // a folded operator is stored as the constant it folded to
+    void serialize(UnitWriter& out) override {
+        if (_fold) {
+            out.u8(UnitWriter::constant_tag);
+            out.value(_fold_value);
+        } else {
+            out.op(BinaryOp::kind, _child);
         }
     }
 
@@ -92,101 +138,161 @@ private:
 struct AddOperator : BinaryOperator<AddOperator> {
     inline static auto op = ValueOp::Add;
     inline static auto name = "+";
+    constexpr static auto kind = OpKind::Add;
     ENABLE_FACTORY_CREATOR(AddOperator);
 };
 
 struct SubOperator : BinaryOperator<SubOperator> {
     inline static auto op = ValueOp::Sub;
     inline static auto name = "-";
+    constexpr static auto kind = OpKind::Sub;
     ENABLE_FACTORY_CREATOR(SubOperator);
 };
 
 struct EqualOperator : BinaryOperator<EqualOperator> {
     inline static auto op = ValueOp::Equal;
     inline static auto name = "==";
+    constexpr static auto kind = OpKind::Equal;
     ENABLE_FACTORY_CREATOR(EqualOperator);
 };
 
 struct NotEqualOperator : BinaryOperator<NotEqualOperator> {
     inline static auto op = ValueOp::NotEqual;
     inline static auto name = "!=";
+    constexpr static auto kind = OpKind::NotEqual;
     ENABLE_FACTORY_CREATOR(NotEqualOperator);
 };
 
 struct MulOperator : BinaryOperator<MulOperator> {
     inline static auto op = ValueOp::Mul;
     inline static auto name = "*";
+    constexpr static auto kind = OpKind::Mul;
     ENABLE_FACTORY_CREATOR(MulOperator);
 };
 
 struct LessOperator : BinaryOperator<LessOperator> {
     inline static auto op = ValueOp::Less;
     inline static auto name = "<";
+    constexpr static auto kind = OpKind::Less;
     ENABLE_FACTORY_CREATOR(LessOperator);
 };
 
 struct GreaterOperator : BinaryOperator<GreaterOperator> {
     inline static auto op = ValueOp::Greater;
     inline static auto name = ">";
+    constexpr static auto kind = OpKind::Greater;
     ENABLE_FACTORY_CREATOR(GreaterOperator);
 };
 
 struct GreaterOrEqualOperator : BinaryOperator<GreaterOrEqualOperator> {
     inline static auto op = ValueOp::GreaterOrEqual;
     inline static auto name = ">=";
+    constexpr static auto kind = OpKind::GreaterOrEqual;
     ENABLE_FACTORY_CREATOR(GreaterOrEqualOperator);
 };
 
 struct LessOrEqualOperator : BinaryOperator<LessOrEqualOperator> {
     inline static auto op = ValueOp::LessOrEqual;
     inline static auto name = "<=";
+    constexpr static auto kind = OpKind::LessOrEqual;
     ENABLE_FACTORY_CREATOR(LessOrEqualOperator);
 };
 
 struct AndOperator : BinaryOperator<AndOperator> {
     inline static auto op = ValueOp::And;
     inline static auto name = "&&";
+    constexpr static auto kind = OpKind::And;
     ENABLE_FACTORY_CREATOR(AndOperator);
 };
 
 struct OrOperator : BinaryOperator<OrOperator> {
     inline static auto op = ValueOp::Or;
     inline static auto name = "||";
+    constexpr static auto kind = OpKind::Or;
     ENABLE_FACTORY_CREATOR(OrOperator);
 };
 
 struct VariableNode : ExprNode {
     ENABLE_FACTORY_CREATOR(VariableNode);
-    VariableNode(const std::string& name) : _name(name) {}
+    VariableNode(SymbolId name) : _name(name) {}
 
     Value exec(Context* ctx) override;
     virtual Value& get_variable(Context* ctx) override;
+    // target = v
+    virtual void assign(Context* ctx, const Value& v) { get_variable(ctx).assign_value(v); }
     ReferenceWrapping& ref(Context* ctx);
     int Opnums() override { return 0; }
 
-    std::string name() const override { return _name; }
+    std::string name() const override { return symbol_name(_name); }
+    SymbolId symbol() const { return _name; }
     bool is_variable() override { return true; }
 
+    void serialize(UnitWriter& out) override {
+        out.u8(UnitWriter::variable_tag);
+        out.symbol(_name);
+    }
+
 private:
     void create_reference_wrapping(Context* ctx);
     ReferenceWrapping _ref;
-    std::string _name;
+    SymbolId _name;
 };
 
 struct SubscriptOperator : VariableNode {
     ENABLE_FACTORY_CREATOR(SubscriptOperator);
-    SubscriptOperator() : VariableNode("[]") {}
+    SubscriptOperator() : VariableNode(intern("[]")) {}
     int Opnums() override { return 2; }
+    void serialize(UnitWriter& out) override { out.op(OpKind::Subscript, _child); }
     Value exec(Context* ctx) override;
     Value& get_variable(Context* ctx) override;
+    // a[i] = v, without boxing an unboxed array
+    void assign(Context* ctx, const Value& v) override;
+
+    // what locate gives as the index for a map
+    constexpr static size_t in_map = SIZE_MAX;
+    // the array and the checked index, the array stays shared. on a map m[k] is the value
+    // under k and the index is in_map.
+    std::pair<Value, size_t> locate(Context* ctx);
+    // the array unshared for writing, and the checked index in i. on a map nullptr, and the
+    // value under the key, added when missing, in element.
+    Array* locate_for_write(Context* ctx, size_t& i, Value*& element);
+};
+
+// a[lo:hi], a[lo:] or a[:hi]: elements lo up to hi as an arr that shares them with a until
+// either is written, so slicing costs the same for any length
+struct SliceOperator : ExprNode {
+    ENABLE_FACTORY_CREATOR(SliceOperator);
+    // without hi the slice runs to the end of the array
+    SliceOperator(bool has_hi) : _has_hi(has_hi) {}
+    Value exec(Context* ctx) override;
+    int Opnums() override { return _has_hi ? 3 : 2; }
+    std::string name() const override;
+    void serialize(UnitWriter& out) override;
+
+private:
+    bool _has_hi;
 };
 
 struct MemberAccessOperator : VariableNode {
     ENABLE_FACTORY_CREATOR(MemberAccessOperator);
-    MemberAccessOperator() : VariableNode("[]") {}
+    MemberAccessOperator() : VariableNode(intern("[]")) {}
     int Opnums() override { return 2; }
+    void serialize(UnitWriter& out) override { out.op(OpKind::Member, _child); }
+    void prepare(Context* ctx) override;
     Value exec(Context* ctx) override;
     Value& get_variable(Context* ctx) override;
+    void assign(Context* ctx, const Value& v) override;
+
+    // x[i].name, which goes straight to the column when x stores its structs by column
+    bool on_element() const { return _element; }
+
+private:
+    SymbolId member_name();
+
+    MemberCache _cache;
+    SubscriptOperator* _element = nullptr;
+    // the object has side effects and is evaluated through get_variable only
+    bool _write_only = false;
 };
 
 inline Value fake_binary_op(const Value&, const Value&) {
@@ -196,14 +302,39 @@ inline Value fake_binary_op(const Value&, const Value&) {
 struct AssignOperator : BinaryOperator<AssignOperator> {
     inline static auto op = fake_binary_op;
     inline static auto name = "=";
+    constexpr static auto kind = OpKind::Assign;
     ENABLE_FACTORY_CREATOR(AssignOperator);
+    // an assignment has a side effect and never folds, even with a constant on the left
+    void fold() override { ExprNode::fold(); }
+    void prepare(Context* ctx) override;
     Value exec(Context* ctx) override {
         CHECK(Lchild()->is_variable(), "= must use in var");
+        Value value;
+        if (_append) {
+            if (append_chain(Rchild(), ctx, value)) return Lchild()->get_variable(ctx);
+        } else {
+            // the right side first: a write through the left side may copy a shared array, an
+            // element reference taken before evaluating the right side could go stale
+            value = Rchild()->exec(ctx);
+        }
+        if (_element) {
+            static_cast<VariableNode*>(Lchild())->assign(ctx, value);
+            return value;
+        }
         Value& ref = dynamic_cast<VariableNode*>(Lchild())->get_variable(ctx);
-        ref.assign_value((Rchild()->exec(ctx)));
+        ref.assign_value(std::move(value));
         return ref;
     }
     int Opnums() override { return 2; }
+
+private:
+    // "s = s + a + b": when s holds a string, a and b are appended to its buffer, so building
+    // a string in a loop is linear instead of quadratic. returns the extended target, or
+    // nullptr with the plain sum in sum when the target is not a string.
+    Value* append_chain(ExprNode* node, Context* ctx, Value& sum);
+    bool _append = false;
+    // the target is an array element or a member of one
+    bool _element = false;
 };
 
 struct Function;
@@ -217,7 +348,7 @@ struct FuncCallOperator : ExprNode {
     int Opnums() override { return _signature.second; }
 
     std::string name() const override {
-        auto func_call_name = _signature.first + "(";
+        auto func_call_name = symbol_name(_signature.first) + "(";
 
         for (auto& child_expr : _child) {
             func_call_name += child_expr->name() + " ";
@@ -229,6 +360,9 @@ struct FuncCallOperator : ExprNode {
     }
 
     void prepare(Context* ctx) override;
+    void collect_refs(ReferenceSink& refs) override;
+
+    void serialize(UnitWriter& out) override { out.call(_signature.first, _child); }
 
     FunctionSignature _signature;
 
@@ -243,13 +377,24 @@ struct RefOperator : ExprNode {
     int Opnums() override { return 1; }
 
     std::string name() const override { return "Ref " + _child[0]->name(); }
+    void serialize(UnitWriter& out) override { out.op(OpKind::Ref, _child); }
 };
 
+// arr N, or arr int N, arr float N, arr bool N for an unboxed array of that type. arr N starts
+// as an int array, its zeros are ints. arr B N holds N default B structs stored by column.
 struct ArrOperator : ExprNode {
     ENABLE_FACTORY_CREATOR(ArrOperator);
+    ArrOperator(Array::Kind kind = Array::Kind::Int) : _kind(kind) {}
+    ArrOperator(SymbolId struct_name) : _kind(Array::Kind::Columns), _struct(struct_name) {}
     Value exec(Context* ctx) override;
     int Opnums() override { return 1; }
-    std::string name() const override { return "Arr " + _child[0]->name(); }
+    std::string name() const override;
+    void collect_refs(ReferenceSink& refs) override;
+    void serialize(UnitWriter& out) override;
+
+private:
+    Array::Kind _kind;
+    SymbolId _struct = SymbolTable::invalid_id;
 };
 
 struct StructOperator : ExprNode {
@@ -257,4 +402,6 @@ struct StructOperator : ExprNode {
     Value exec(Context* ctx) override;
     int Opnums() override { return 1; }
     std::string name() const override { return "Let " + _child[0]->name(); }
+    void collect_refs(ReferenceSink& refs) override;
+    void serialize(UnitWriter& out) override { out.op(OpKind::Let, _child); }
 };
\ No newline at end of file
@@ -2,211 +2,239 @@
 
 #include "Context.h"
 #include "Function.h"
+#include "Number.h"
 
 Expr ExprBuild::build(Context* ctx, TokenStream& stream) {
-    int left_bracket = 0;
+    return Expr {parse_expr(ctx, stream, lowest_priority)};
+}
+
+ExprBuild::NodePtr ExprBuild::parse_expr(Context* ctx, TokenStream& stream, int min_priority) {
+    return parse_infix(ctx, stream, parse_operand(ctx, stream), min_priority);
+}
 
-    CHECK(stk.empty(), "stk must be empty()");
-    CHECK(stk_op.empty(), "stk_op must be empty()");
-    auto token_pos_begin = stream.cur_pos();
+ExprBuild::NodePtr ExprBuild::parse_infix(Context* ctx, TokenStream& stream, NodePtr lhs,
+                                          int min_priority) {
     while (!stream.end()) {
-        auto token = stream.top();
-        if (token.type() == Token::Type::constant) {
-            stream.get();
-            stk.push(std::move(build_constant(token)));
-        } else if (token.type() == Token::variable) {
-            stream.get();
-            stk.push(std::move(build_variable(ctx, stream, token)));
-        } else if (token.type() == Token::Type::op) {
-            stream.get();
-            if (stk_op.empty()) {
-                stk_op.push(token);
-            } else {
-                while (!stk_op.empty() && stk_op.top() != Token {"(", Token::Type::bracket} &&
-                       stk_op.top().priority() >= token.priority()) {
-                    stk.push(std::move(build_op(stk_op.top())));
-                    stk_op.pop();
-                }
-                stk_op.push(token);
-            }
-        } else if (token == Token {"(", Token::Type::bracket}) {
-            stream.get();
-            stk_op.push(token);
-            left_bracket++;
-        } else if (token == Token {")", Token::Type::bracket} && left_bracket) {
-            stream.get();
-            while (!stk_op.empty() && stk_op.top() != Token {"(", Token::Type::bracket}) {
-                stk.push(std::move(build_op(stk_op.top())));
-                stk_op.pop();
-            }
-            CHECK((!stk_op.empty() && stk_op.top() == Token {"(", Token::Type::bracket}),
-                  ") match fail stk size " + std::to_string(stk.size()));
-            stk_op.pop();
-            left_bracket--;
-        } else if (token == Token {"[", Token::Type::bracket}) {
-            stream.get();
-            stk.push(std::move(build_subscript(ctx, stream, token)));
-        } else {
-            break;
+        auto kind = stream.top().op_kind();
+        if (kind == OpKind::None) break;
+        const auto& info = Token::op_info(kind);
+        // a prefix operator after an operand ends the expression
+        if (info.arity != 2 || info.priority < min_priority) break;
+        auto token = stream.get();
+        if (!has_op_node(kind)) {
+            stream.error(token, "unsupported operator '" + std::string(token.str()) + "'");
         }
+        if (kind == OpKind::Subscript) {
+            lhs = build_subscript(ctx, stream, lhs);
+            continue;
+        }
+        auto rhs = parse_expr(ctx, stream,
+                              info.assoc == Assoc::Left ? info.priority + 1 : info.priority);
+        lhs = build_op(ctx->arena(), kind, lhs, rhs);
     }
-    CHECK(!stk.empty(), "!stk.empty()");
-    while (!stk_op.empty()) {
-        stk.push(std::move(build_op(stk_op.top())));
-        stk_op.pop();
+    return lhs;
+}
+
+ExprBuild::NodePtr ExprBuild::parse_operand(Context* ctx, TokenStream& stream) {
+    const auto& token = stream.get();
+    switch (token.type()) {
+    case Token::Type::constant:
+        return build_constant(ctx, token);
+    case Token::Type::variable:
+        return build_variable(ctx, stream, token);
+    case Token::Type::op: {
+        const auto& info = Token::op_info(token.op_kind());
+        if (info.arity != 1) {
+            stream.error(token, "expected an expression before '" + std::string(token.str()) + "'");
+        }
+        if (!has_op_node(token.op_kind())) {
+            stream.error(token, "unsupported operator '" + std::string(token.str()) + "'");
+        }
+        if (token.op_kind() == OpKind::Arr) return build_arr(ctx, stream, info.priority);
+        auto child = parse_expr(ctx, stream, info.priority);
+        return build_op(ctx->arena(), token.op_kind(), child, nullptr);
+    }
+    case Token::Type::bracket:
+        if (token.str() == "(") {
+            auto node = parse_expr(ctx, stream, lowest_priority);
+            stream.eat(")");
+            return node;
+        }
+        break;
+    default:
+        break;
     }
-    CHECK(stk.size() == 1, "stk.size() == 1");
-    auto expr_name = stream.get_token_string(token_pos_begin, stream.cur_pos());
-    Expr expr {std::move(stk.top())};
-    stk.pop();
-    return expr;
+    stream.error(token, "expected an expression but found '" + std::string(token.str()) + "'");
 }
 
 Value ExprBuild::parser_constant(const Token& token) {
     auto str = token.str();
-    if (str.front() == '\"') {
-        return Value {str.substr(1, str.size() - 1)};
-    } else {
-        if (auto v = tryParseBool(str)) {
-            return Value {*v};
-        } else if (auto v = tryParseInt(str)) {
-            return Value {*v};
-        } else if (auto v = tryParseFloat(str)) {
-            return Value {*v};
-        } else {
-            return Value::default_value;
-        }
+    switch (token.literal()) {
+    case Token::Literal::string:
+        return Value::make_Interned(str.substr(1));
+    case Token::Literal::integer:
+        if (auto v = Number::parse_int(str)) return Value {*v};
+        // too large for an int64, read as a float
+        [[fallthrough]];
+    case Token::Literal::decimal:
+        if (auto v = Number::parse_float(str)) return Value {*v};
+        [[fallthrough]];
+    default:
+        return Value::default_value;
     }
 }
 
-std::unique_ptr<ExprNode> ExprBuild::build_constant(Token token) {
-    auto str = token.str();
-    return ConstantValueNode::create_unique(parser_constant(token));
+ExprBuild::NodePtr ExprBuild::build_constant(Context* ctx, const Token& token) {
+    return ctx->arena()->create<ConstantValueNode>(parser_constant(token));
 }
 
 template <typename T>
-std::unique_ptr<ExprNode> ExprBuild::build_binary_op() {
-    CHECK(stk.size() >= 2, "binary op failed");
-    std::unique_ptr<ExprNode> rhs = std::move(stk.top());
-    stk.pop();
-    std::unique_ptr<ExprNode> lhs = std::move(stk.top());
-    stk.pop();
-    auto op = T::create_unique();
-    op->add_child(std::move(lhs));
-    op->add_child(std::move(rhs));
+ExprBuild::NodePtr ExprBuild::build_binary_op(Arena* arena, NodePtr lhs, NodePtr rhs) {
+    auto* op = arena->create<T>();
+    op->set_children(arena, {{lhs, rhs}});
     return op;
 }
 
 template <typename T>
-std::unique_ptr<ExprNode> ExprBuild::build_unary_op() {
-    CHECK(stk.size() >= 1, "unary op failed");
-    std::unique_ptr<ExprNode> child = std::move(stk.top());
-    stk.pop();
-    auto op = T::create_unique();
-    op->add_child(std::move(child));
+ExprBuild::NodePtr ExprBuild::build_unary_op(Arena* arena, NodePtr child) {
+    auto* op = arena->create<T>();
+    op->set_children(arena, {{child}});
     return op;
 }
 
-std::unique_ptr<ExprNode> ExprBuild::build_op(Token token) {
-    auto s = token.str();
-    if (s == "+") {
-        return build_binary_op<AddOperator>();
-    }
-    if (s == "*") {
-        return build_binary_op<MulOperator>();
-    }
-    if (s == "-") {
-        return build_binary_op<SubOperator>();
-    }
-    if (s == "==") {
-        return build_binary_op<EqualOperator>();
-    }
-    if (s == "!=") {
-        return build_binary_op<NotEqualOperator>();
-    }
-    if (s == "=") {
-        return build_binary_op<AssignOperator>();
-    }
-    if (s == "<=") {
-        return build_binary_op<LessOrEqualOperator>();
-    }
-    if (s == ">=") {
-        return build_binary_op<GreaterOrEqualOperator>();
-    }
-    if (s == "<") {
-        return build_binary_op<LessOperator>();
-    }
-    if (s == ">") {
-        return build_binary_op<GreaterOperator>();
-    }
-    if (s == "&&") {
-        return build_binary_op<AndOperator>();
-    }
-    if (s == "||") {
-        return build_binary_op<OrOperator>();
+namespace {
+// node type built for each operator, void for the ones without a node
+template <OpKind kind>
+struct OpNode {
+    using type = void;
+};
+#define OP_NODE(kind, node)         \
+    template <>                     \
+    struct OpNode<OpKind::kind> {   \
+        using type = node;          \
+    };
+OP_NODE(Add, AddOperator)
+OP_NODE(Sub, SubOperator)
+OP_NODE(Mul, MulOperator)
+OP_NODE(Equal, EqualOperator)
+OP_NODE(NotEqual, NotEqualOperator)
+OP_NODE(Assign, AssignOperator)
+OP_NODE(Member, MemberAccessOperator)
+OP_NODE(LessOrEqual, LessOrEqualOperator)
+OP_NODE(GreaterOrEqual, GreaterOrEqualOperator)
+OP_NODE(Less, LessOperator)
+OP_NODE(Greater, GreaterOperator)
+OP_NODE(And, AndOperator)
+OP_NODE(Or, OrOperator)
+OP_NODE(Ref, RefOperator)
+OP_NODE(Arr, ArrOperator)
+OP_NODE(Let, StructOperator)
+OP_NODE(Subscript, SubscriptOperator)
+#undef OP_NODE
+} // namespace
+
+template <OpKind kind>
+ExprBuild::NodePtr ExprBuild::build_op_of(Arena* arena, NodePtr lhs, NodePtr rhs) {
+    using Node = typename OpNode<kind>::type;
+    static_assert(!std::is_void_v<Node>, "the parser rejects operators without a node");
+    if constexpr (Token::op_info(kind).arity == 1) {
+        return build_unary_op<Node>(arena, lhs);
+    } else {
+        return build_binary_op<Node>(arena, lhs, rhs);
     }
+}
 
-    if (s == ".") {
-        return build_binary_op<MemberAccessOperator>();
+template <OpKind kind>
+constexpr ExprBuild::OpFactory ExprBuild::op_factory() {
+    if constexpr (std::is_void_v<typename OpNode<kind>::type>) {
+        return nullptr;
+    } else {
+        return &ExprBuild::build_op_of<kind>;
     }
+}
 
-    if (s == "&") {
-        return build_unary_op<RefOperator>();
-    }
+template <size_t... kinds>
+constexpr std::array<ExprBuild::OpFactory, sizeof...(kinds)> ExprBuild::make_op_factories(
+        std::index_sequence<kinds...>) {
+    return {op_factory<OpKind(kinds)>()...};
+}
 
-    if (s == "arr") {
-        return build_unary_op<ArrOperator>();
-    }
+const std::array<ExprBuild::OpFactory, Token::op_kind_count> ExprBuild::op_factories =
+        ExprBuild::make_op_factories(std::make_index_sequence<Token::op_kind_count> {});
 
-    if (s == "let") {
-        return build_unary_op<StructOperator>();
-    }
+ExprBuild::NodePtr ExprBuild::build_op(Arena* arena, OpKind kind, NodePtr lhs, NodePtr rhs) {
+    return op_factories[size_t(kind)](arena, lhs, rhs);
+}
 
-    return nullptr;
+bool ExprBuild::has_op_node(OpKind kind) {
+    return op_factories[size_t(kind)] != nullptr;
 }
 
-std::unique_ptr<ExprNode> ExprBuild::build_variable(Context* ctx, TokenStream& stream,
-                                                    Token token) {
+ExprBuild::NodePtr ExprBuild::build_variable(Context* ctx, TokenStream& stream,
+                                             const Token& token) {
     const bool is_func = stream.top_equal("(");
     if (is_func) {
         return build_function(ctx, stream, token);
     }
-    return VariableNode::create_unique(token.str());
+    return ctx->arena()->create<VariableNode>(token.symbol());
 }
 
-std::unique_ptr<ExprNode> ExprBuild::build_function(Context* ctx, TokenStream& stream,
-                                                    Token token) {
-    const auto& func_name = token.str();
-    ExprBuild builder;
-    std::vector<Expr> params;
-    auto args = 0;
+ExprBuild::NodePtr ExprBuild::build_function(Context* ctx, TokenStream& stream,
+                                             const Token& token) {
+    const auto params_begin = _params.size();
     stream.eat("(");
     while (!stream.top_equal(")")) {
-        auto expr = builder.build(ctx, stream);
+        auto* param = parse_expr(ctx, stream, lowest_priority);
+        _params.push_back(param);
         if (!stream.top_equal(")")) stream.eat(",");
-        params.push_back(std::move(expr));
-        args++;
     }
     stream.eat(")");
-    auto func_call = FuncCallOperator::create_unique(FunctionSignature {func_name, args});
-    for (auto& expr : params) func_call->add_child(std::move(expr.node()));
+    auto params = std::span(_params).subspan(params_begin);
+    auto* func_call = ctx->arena()->create<FuncCallOperator>(
+            FunctionSignature {token.symbol(), int(params.size())});
+    func_call->set_children(ctx->arena(), params);
+    _params.resize(params_begin);
     return func_call;
 }
 
-std::unique_ptr<ExprNode> ExprBuild::build_subscript(Context* ctx, TokenStream& stream,
-                                                     Token token) {
-    while (!stk_op.empty() && stk_op.top() != Token {"(", Token::Type::bracket} &&
-           stk_op.top().priority() >= token.priority()) {
-        stk.push(std::move(build_op(stk_op.top())));
-        stk_op.pop();
-    }
-    auto Lchild = std::move(stk.top());
-    stk.pop();
-    ExprBuild builder;
-    auto Rchild = builder.build(ctx, stream);
-    auto subscript_op = SubscriptOperator::create_unique();
-    subscript_op->add_child(std::move(Lchild));
-    subscript_op->add_child(std::move(Rchild.node()));
+ExprBuild::NodePtr ExprBuild::build_arr(Context* ctx, TokenStream& stream, int priority) {
+    constexpr std::pair<std::string_view, Array::Kind> element_types[] = {
+            {"int", Array::Kind::Int}, {"float", Array::Kind::Float}, {"bool", Array::Kind::Bool}};
+    if (stream.end() || !stream.top_equal(Token::Type::variable)) {
+        return build_op(ctx->arena(), OpKind::Arr, parse_expr(ctx, stream, priority), nullptr);
+    }
+    // a name directly followed by the size names the element type: arr int n, arr B 10.
+    // otherwise the name starts the size itself: arr n, arr int(x), arr n * 2.
+    auto token = stream.get();
+    if (stream.end() || !(stream.top_equal(Token::Type::variable) ||
+                          stream.top_equal(Token::Type::constant))) {
+        auto size = parse_infix(ctx, stream, build_variable(ctx, stream, token), priority);
+        return build_op(ctx->arena(), OpKind::Arr, size, nullptr);
+    }
+    auto name = token.str();
+    auto it = std::find_if(std::begin(element_types), std::end(element_types),
+                           [&](const auto& type) { return type.first == name; });
+    auto* arr = it != std::end(element_types)
+                        ? ctx->arena()->create<ArrOperator>(it->second)
+                        : ctx->arena()->create<ArrOperator>(token.symbol());
+    arr->set_children(ctx->arena(), {{parse_expr(ctx, stream, priority)}});
+    return arr;
+}
+
+ExprBuild::NodePtr ExprBuild::build_subscript(Context* ctx, TokenStream& stream, NodePtr lhs) {
+    auto* arena = ctx->arena();
+    NodePtr index = stream.top_equal(":") ? arena->create<ConstantValueNode>(0)
+                                          : parse_expr(ctx, stream, lowest_priority);
+    if (!stream.top_equal(":")) {
+        stream.eat("]");
+        return build_op(arena, OpKind::Subscript, lhs, index);
+    }
+    // a[lo:hi], either bound may be left out
+    stream.eat(":");
+    std::vector<NodePtr> children {lhs, index};
+    if (!stream.top_equal("]")) children.push_back(parse_expr(ctx, stream, lowest_priority));
     stream.eat("]");
-    return subscript_op;
+    auto* slice = arena->create<SliceOperator>(children.size() == 3);
+    slice->set_children(arena, children);
+    return slice;
 }
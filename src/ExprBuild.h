@@ -1,42 +1,74 @@
 #pragma once
 
-#include <stack>
+#include <limits>
 
 #include "Expr.h"
 #include "Token.h"
 
 struct Context;
 
+// the node is owned by the program's Arena
 struct Expr {
     Expr() {}
-    Expr(std::unique_ptr<ExprNode> node) : _node(std::move(node)) {}
+    Expr(ExprNode* node) : _node(node) {}
     auto operator()(Context* ctx) { return _node->exec(ctx); }
     auto& node() { return _node; }
     auto expr_name() { return _node->name(); }
     void prepare(Context* ctx) { _node->prepare(ctx); }
+    void fold() { _node->fold(); }
+    void collect_refs(ReferenceSink& refs) { _node->collect_refs(refs); }
 
 private:
-    std::unique_ptr<ExprNode> _node;
-    std::string _expr_name;
+    ExprNode* _node = nullptr;
 };
 
+// pratt parser: operands and prefix operators are parsed by parse_operand, then binary
+// operators and [ ] are folded in while they bind at least as tight as min_priority.
 struct ExprBuild {
+    using NodePtr = ExprNode*;
+
     static Value parser_constant(const Token& token);
     Expr build(Context* ctx, TokenStream& stream);
 
+    // rhs is null for prefix operators, only kinds with has_op_node can be built
+    static NodePtr build_op(Arena* arena, OpKind kind, NodePtr lhs, NodePtr rhs);
+    static bool has_op_node(OpKind kind);
+
 private:
-    std::stack<std::unique_ptr<ExprNode>> stk;
-    std::stack<Token> stk_op;
-    std::unique_ptr<ExprNode> build_constant(Token token);
-    std::unique_ptr<ExprNode> build_variable(Context* ctx, TokenStream& stream, Token token);
-    std::unique_ptr<ExprNode> build_function(Context* ctx, TokenStream& stream, Token token);
-    std::unique_ptr<ExprNode> build_subscript(Context* ctx, TokenStream& stream, Token token);
+    constexpr static int lowest_priority = std::numeric_limits<int>::min();
 
-    std::unique_ptr<ExprNode> build_op(Token token);
+    NodePtr parse_expr(Context* ctx, TokenStream& stream, int min_priority);
+    // the binary operators after an operand that is already parsed
+    NodePtr parse_infix(Context* ctx, TokenStream& stream, NodePtr lhs, int min_priority);
+    NodePtr parse_operand(Context* ctx, TokenStream& stream);
+
+    NodePtr build_constant(Context* ctx, const Token& token);
+    NodePtr build_variable(Context* ctx, TokenStream& stream, const Token& token);
+    NodePtr build_function(Context* ctx, TokenStream& stream, const Token& token);
+    NodePtr build_subscript(Context* ctx, TokenStream& stream, NodePtr lhs);
+    // arr N, arr int N, arr float N or arr bool N
+    NodePtr build_arr(Context* ctx, TokenStream& stream, int priority);
 
     template <typename T>
-    std::unique_ptr<ExprNode> build_binary_op();
+    static NodePtr build_binary_op(Arena* arena, NodePtr lhs, NodePtr rhs);
 
     template <typename T>
-    std::unique_ptr<ExprNode> build_unary_op();
-};
\ No newline at end of file
+    static NodePtr build_unary_op(Arena* arena, NodePtr child);
+
+    // rhs is null for prefix operators
+    template <OpKind kind>
+    static NodePtr build_op_of(Arena* arena, NodePtr lhs, NodePtr rhs);
+
+    using OpFactory = NodePtr (*)(Arena*, NodePtr, NodePtr);
+    // build_op_of<kind>, null for a kind without a node
+    template <OpKind kind>
+    constexpr static OpFactory op_factory();
+    template <size_t... kinds>
+    constexpr static std::array<OpFactory, sizeof...(kinds)> make_op_factories(
+            std::index_sequence<kinds...>);
+    // indexed by OpKind
+    static const std::array<OpFactory, Token::op_kind_count> op_factories;
+
+    // arguments of the calls being parsed, nested calls push on top of their parent's
+    std::vector<NodePtr> _params;
+};
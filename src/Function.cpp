@@ -2,8 +2,11 @@
 
 #include "Ast.h"
 #include "Context.h"
+#include "Kernels.h"
+#include "Map.h"
 
 Value DefFunction::exce(Context* ctx, std::vector<Value> args) {
+    if (_funcnode->is_lazy()) _funcnode->compile(_unit, ctx->global());
     ctx->push_func(func_name());
     for (int i = 0; i < args.size(); i++) {
         ctx->func()->variable_mgr()->set(_args_name[i], args[i]);
@@ -31,11 +34,18 @@ struct type {
 
     static Value exec(Context* ctx, std::vector<Value> args) {
         Value v = args[0];
-        std::string type_info = type_to_str(v.type());
-        if (v.type() == Type::Ref) {
-            type_info += "  " + v.ref_debug_info();
+        if (v.type() != Type::Ref) {
+            // built once, every call hands out the same interned name
+            static const auto names = [] {
+                std::vector<Value> names;
+                for (auto t = Type::Int; t <= Type::Map; t = Type(uint8_t(t) + 1)) {
+                    names.push_back(Value::make_Interned(type_to_str(t)));
+                }
+                return names;
+            }();
+            return names[size_t(v.type())];
         }
-        return type_info;
+        return type_to_str(v.type()) + "  " + v.ref_debug_info();
     }
 };
 
@@ -46,9 +56,11 @@ struct len {
     static Value exec(Context* ctx, std::vector<Value> args) {
         Value v = args[0];
         if (v.is_arr()) {
-            return std::get<ArrValue>(v.value()).arr().size();
+            return v.get_array().size();
+        } else if (v.is_map()) {
+            return v.get_map().size();
         } else if (v.is_str()) {
-            return std::get<StringValue>(v.value()).CppValue().size();
+            return v.as_string().size();
         } else if (v.is_ref()) {
             return exec(ctx, {v.ref()});
         }
@@ -84,9 +96,16 @@ struct trans {
     static Value exec(Context* ctx, std::vector<Value> args) {
         Value v = args[0];
         CHECK(v.is_struct(), "trans must use in struct");
+        // members are listed by name, not by symbol id
+        std::vector<std::pair<std::string_view, Value>> members;
+        auto& fields = v.get_struct();
+        for (size_t i = 0; i < fields.size(); i++) {
+            members.emplace_back(symbol_name(fields.name(i)), fields.slots[i]);
+        }
+        std::sort(members.begin(), members.end(),
+                  [](const auto& l, const auto& r) { return l.first < r.first; });
         std::vector<Value> arr;
-        auto map = v.get_struct();
-        for (auto& [name, var] : map) {
+        for (auto& [_, var] : members) {
             arr.push_back(var);
         }
         return Value::make_Arr(arr);
@@ -101,11 +120,12 @@ struct range_3 {
         Value L = args[0];
         Value R = args[1];
         Value step = args[2];
-        std::vector<Value> arr;
+        Array arr(0, Array::Kind::Int);
+        auto& ints = arr.buffer<Array::Ints>();
         for (auto i = L.get_int(); i < R.get_int(); i += step.get_int()) {
-            arr.push_back(i);
+            ints.push_back(i);
         }
-        return Value::make_Arr(arr);
+        return Value::make_Arr(std::move(arr));
     }
 };
 
@@ -119,6 +139,284 @@ struct range_2 {
     }
 };
 
+// sum, min, max, dot, vadd and vmul run the kernels on unboxed int and float arrays. any other
+// array goes element by element with the operators of + * and <, so results match the loops
+// a program would write, apart from the order float sums are added in.
+namespace {
+const Array& array_arg(const Value& v, const char* func) {
+    CHECK(v.is_arr(), std::string(func) + " must use in arr, now is " + type_to_str(v.type()));
+    return v.get_array();
+}
+
+template <typename Kernel, typename Op>
+Value zip(const std::vector<Value>& args, const char* func, Kernel kernel, Op op) {
+    auto& a = array_arg(args[0], func);
+    auto& b = array_arg(args[1], func);
+    CHECK(a.size() == b.size(), std::string(func) + " needs arrs of the same size");
+    if (a.element_kind() == b.element_kind() && a.element_kind() == Array::Kind::Int) {
+        Array out(a.size(), Array::Kind::Int);
+        kernel(a.elements<Array::Ints>(), b.elements<Array::Ints>(), out.buffer<Array::Ints>());
+        return Value::make_Arr(std::move(out));
+    }
+    if (a.element_kind() == b.element_kind() && a.element_kind() == Array::Kind::Float) {
+        Array out(a.size(), Array::Kind::Float);
+        kernel(a.elements<Array::Floats>(), b.elements<Array::Floats>(),
+               out.buffer<Array::Floats>());
+        return Value::make_Arr(std::move(out));
+    }
+    std::vector<Value> out;
+    out.reserve(a.size());
+    for (size_t i = 0; i < a.size(); i++) out.push_back(op(a.get(i), b.get(i)));
+    return Value::make_Arr(std::move(out));
+}
+
+template <bool is_min>
+Value extreme(const std::vector<Value>& args, const char* func) {
+    auto& a = array_arg(args[0], func);
+    CHECK(a.size() > 0, std::string(func) + " of an empty arr");
+    if (a.element_kind() == Array::Kind::Int) {
+        auto ints = a.elements<Array::Ints>();
+        return is_min ? Kernels::min(ints) : Kernels::max(ints);
+    }
+    if (a.element_kind() == Array::Kind::Float) {
+        auto floats = a.elements<Array::Floats>();
+        return is_min ? Kernels::min(floats) : Kernels::max(floats);
+    }
+    Value best = a.get(0);
+    for (size_t i = 1; i < a.size(); i++) {
+        Value x = a.get(i);
+        if (is_min ? ValueOp::_less(x, best) : ValueOp::_less(best, x)) best = x;
+    }
+    return best;
+}
+} // namespace
+
+struct sum {
+    constexpr static auto name = "sum";
+    constexpr static auto counter = 1;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        auto& a = array_arg(args[0], name);
+        if (a.element_kind() == Array::Kind::Int) return Kernels::sum(a.elements<Array::Ints>());
+        if (a.element_kind() == Array::Kind::Float) {
+            return Kernels::sum(a.elements<Array::Floats>());
+        }
+        Value total = 0;
+        for (size_t i = 0; i < a.size(); i++) total = ValueOp::Add(total, a.get(i));
+        return total;
+    }
+};
+
+struct min {
+    constexpr static auto name = "min";
+    constexpr static auto counter = 1;
+
+    static Value exec(Context* ctx, std::vector<Value> args) { return extreme<true>(args, name); }
+};
+
+struct max {
+    constexpr static auto name = "max";
+    constexpr static auto counter = 1;
+
+    static Value exec(Context* ctx, std::vector<Value> args) { return extreme<false>(args, name); }
+};
+
+struct dot {
+    constexpr static auto name = "dot";
+    constexpr static auto counter = 2;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        auto& a = array_arg(args[0], name);
+        auto& b = array_arg(args[1], name);
+        CHECK(a.size() == b.size(), "dot needs arrs of the same size");
+        if (a.element_kind() == b.element_kind() && a.element_kind() == Array::Kind::Int) {
+            return Kernels::dot(a.elements<Array::Ints>(), b.elements<Array::Ints>());
+        }
+        if (a.element_kind() == b.element_kind() && a.element_kind() == Array::Kind::Float) {
+            return Kernels::dot(a.elements<Array::Floats>(), b.elements<Array::Floats>());
+        }
+        Value total = 0;
+        for (size_t i = 0; i < a.size(); i++) {
+            total = ValueOp::Add(total, ValueOp::Mul(a.get(i), b.get(i)));
+        }
+        return total;
+    }
+};
+
+struct vadd {
+    constexpr static auto name = "vadd";
+    constexpr static auto counter = 2;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        return zip(args, name, [](auto a, auto b, auto& out) { Kernels::add(a, b, out); },
+                   ValueOp::Add);
+    }
+};
+
+struct vmul {
+    constexpr static auto name = "vmul";
+    constexpr static auto counter = 2;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        return zip(args, name, [](auto a, auto b, auto& out) { Kernels::mul(a, b, out); },
+                   ValueOp::Mul);
+    }
+};
+
+// a new arr as long as a with every element v. builtins get their arguments by value, so
+// the result is returned: a = fill(a, 0)
+struct fill {
+    constexpr static auto name = "fill";
+    constexpr static auto counter = 2;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        return Value::make_Arr(Array::filled(array_arg(args[0], name).size(), args[1]));
+    }
+};
+
+namespace {
+// the arr behind the reference a growing builtin gets, unshared for writing
+Array& target_arg(Value& v, const char* func) {
+    CHECK(v.is_ref(), std::string(func) + " needs a reference to an arr: " + func + "(&a, ...)");
+    CHECK(v.deref().is_arr(), std::string(func) + " must use in arr, now is " +
+                                      type_to_str(v.deref().type()));
+    return v.write_array();
+}
+} // namespace
+
+// push, pop, insert, resize and reserve change the arr in place through a reference, without
+// copying it: push(&a, v) appends in amortized constant time
+struct push {
+    constexpr static auto name = "push";
+    constexpr static auto counter = 2;
+    constexpr static auto takes_ref = true;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        target_arg(args[0], name).push(args[1]);
+        return Value::default_value;
+    }
+};
+
+struct pop {
+    constexpr static auto name = "pop";
+    constexpr static auto counter = 1;
+    constexpr static auto takes_ref = true;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        auto& a = target_arg(args[0], name);
+        CHECK(a.size() > 0, "pop of an empty arr");
+        return a.pop();
+    }
+};
+
+// insert(&a, i, v) moves a[i] and everything after it up by one, i may be len(a)
+struct insert {
+    constexpr static auto name = "insert";
+    constexpr static auto counter = 3;
+    constexpr static auto takes_ref = true;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        auto& a = target_arg(args[0], name);
+        auto i = args[1].get_int();
+        CHECK(i >= 0 && i <= int64_t(a.size()), "insert out of bound in arr now size " +
+                                                        std::to_string(a.size()) + " want " +
+                                                        std::to_string(i));
+        a.insert(i, args[2]);
+        return Value::default_value;
+    }
+};
+
+// resize(&a, n, v) fills new elements with v, resize(&a, n) with the zero of a's elements
+struct resize_3 {
+    constexpr static auto name = "resize";
+    constexpr static auto counter = 3;
+    constexpr static auto takes_ref = true;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        auto n = args[1].get_int();
+        CHECK(n >= 0, "resize to a negative size " + std::to_string(n));
+        target_arg(args[0], name).resize(n, args[2]);
+        return Value::default_value;
+    }
+};
+
+struct resize_2 {
+    constexpr static auto name = "resize";
+    constexpr static auto counter = 2;
+    constexpr static auto takes_ref = true;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        args.push_back(target_arg(args[0], name).zero());
+        return resize_3::exec(ctx, args);
+    }
+};
+
+struct reserve {
+    constexpr static auto name = "reserve";
+    constexpr static auto counter = 2;
+    constexpr static auto takes_ref = true;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        auto n = args[1].get_int();
+        CHECK(n >= 0, "reserve of a negative size " + std::to_string(n));
+        target_arg(args[0], name).reserve(n);
+        return Value::default_value;
+    }
+};
+
+// map() is an empty map, m[k] = v adds or replaces the value under k, m[k] reads it. keys are
+// ints or strings.
+struct map {
+    constexpr static auto name = "map";
+    constexpr static auto counter = 0;
+
+    static Value exec(Context* ctx, std::vector<Value> args) { return Value::make_Map(); }
+};
+
+namespace {
+const Map& map_arg(const Value& v, const char* func) {
+    CHECK(v.is_map(), std::string(func) + " must use in map, now is " + type_to_str(v.type()));
+    return v.get_map();
+}
+} // namespace
+
+struct has {
+    constexpr static auto name = "has";
+    constexpr static auto counter = 2;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        return map_arg(args[0], name).find(args[1]) != nullptr;
+    }
+};
+
+// the keys in insertion order
+struct keys {
+    constexpr static auto name = "keys";
+    constexpr static auto counter = 1;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        auto& map = map_arg(args[0], name);
+        std::vector<Value> out;
+        out.reserve(map.size());
+        for (auto& entry : map.entries()) out.push_back(entry.key);
+        return Value::make_Arr(std::move(out));
+    }
+};
+
+// erase(&m, k) removes k from the map in place like push, false when k was missing
+struct erase {
+    constexpr static auto name = "erase";
+    constexpr static auto counter = 2;
+    constexpr static auto takes_ref = true;
+
+    static Value exec(Context* ctx, std::vector<Value> args) {
+        auto& m = args[0];
+        CHECK(m.is_ref(), "erase needs a reference to a map: erase(&m, k)");
+        CHECK(m.deref().is_map(), "erase must use in map, now is " + type_to_str(m.deref().type()));
+        return m.write_map().erase(args[1]);
+    }
+};
+
 }; // namespace build_in_function
 
 void FunctionMgr::built_in_functions() {
@@ -130,4 +428,21 @@ void FunctionMgr::built_in_functions() {
     register_built_in<build_in_function::trans>();
     register_built_in<build_in_function::range_3>();
     register_built_in<build_in_function::range_2>();
+    register_built_in<build_in_function::sum>();
+    register_built_in<build_in_function::min>();
+    register_built_in<build_in_function::max>();
+    register_built_in<build_in_function::dot>();
+    register_built_in<build_in_function::fill>();
+    register_built_in<build_in_function::vadd>();
+    register_built_in<build_in_function::vmul>();
+    register_built_in<build_in_function::push>();
+    register_built_in<build_in_function::pop>();
+    register_built_in<build_in_function::insert>();
+    register_built_in<build_in_function::resize_3>();
+    register_built_in<build_in_function::resize_2>();
+    register_built_in<build_in_function::reserve>();
+    register_built_in<build_in_function::map>();
+    register_built_in<build_in_function::has>();
+    register_built_in<build_in_function::keys>();
+    register_built_in<build_in_function::erase>();
 }
\ No newline at end of file
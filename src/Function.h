@@ -9,64 +9,107 @@
 #include "iostream"
 #include "util.h"
 
+struct CompileUnit;
 struct Context;
 struct FuncNode;
 
-using FunctionSignature = std::pair<std::string, int>;
+using FunctionSignature = std::pair<SymbolId, int>;
+
+struct FunctionSignatureHash {
+    size_t operator()(const FunctionSignature& signature) const {
+        return (size_t(signature.first) << 8) ^ size_t(signature.second);
+    }
+};
 
 struct Function {
     Function(const FunctionSignature& signature) : _signature(signature) {}
     virtual Value exce(Context* ctx, std::vector<Value> args) = 0;
-    std::string func_name() const { return _signature.first; }
+    const std::string& func_name() const { return symbol_name(_signature.first); }
     auto args() const { return _signature.second; }
 
 private:
     const FunctionSignature _signature;
 };
 
+// builtins get their arguments by value with refs removed. one that sets takes_ref keeps its
+// first argument as it was passed, so it can change the variable behind push(&a, v).
 struct BuiltInFunction : Function {
     using BuiltInType = std::function<Value(Context*, std::vector<Value>)>;
-    BuiltInFunction(BuiltInType func, const FunctionSignature& signature)
-            : _func(func), Function(signature) {}
+    BuiltInFunction(BuiltInType func, const FunctionSignature& signature, bool takes_ref = false)
+            : Function(signature), _func(func), _takes_ref(takes_ref) {}
     Value exce(Context* ctx, std::vector<Value> args) override {
-        std::vector<Value> remove_ref_args;
-        for (auto& v : args) {
-            if (v.is_ref())
-                remove_ref_args.push_back(v.ref());
-            else
-                remove_ref_args.push_back(v);
+        for (size_t i = _takes_ref ? 1 : 0; i < args.size(); i++) {
+            if (!args[i].is_ref()) continue;
+            Value v = args[i].ref();
+            args[i] = std::move(v);
         }
-        return _func(ctx, remove_ref_args);
+        return _func(ctx, std::move(args));
     }
     BuiltInType _func;
+    bool _takes_ref;
 };
 
 struct DefFunction : public Function {
-    DefFunction(FuncNode* funcnode,  const std::vector<std::string>& args_name,
-                const FunctionSignature& signature)
-            : _funcnode(funcnode), _args_name(args_name), Function(signature) {}
+    DefFunction(FuncNode* funcnode, const std::vector<SymbolId>& args_name,
+                const FunctionSignature& signature, CompileUnit* unit = nullptr)
+            : Function(signature), _funcnode(funcnode), _args_name(args_name), _unit(unit) {}
 
     Value exce(Context* ctx, std::vector<Value> args) override;
     virtual ~DefFunction() = default;
     FuncNode* _funcnode;
-    const std::vector<std::string> _args_name;
+    const std::vector<SymbolId> _args_name;
+    // where a lazy body is parsed from and into
+    CompileUnit* _unit;
 };
 
 struct FunctionMgr {
     FunctionMgr() { built_in_functions(); }
-    std::map<FunctionSignature, std::shared_ptr<Function>> _mgr;
+    std::unordered_map<FunctionSignature, std::shared_ptr<Function>, FunctionSignatureHash> _mgr;
     auto get_func(FunctionSignature signature) {
-        CHECK(_mgr.contains(signature), "can not find funciton name  " + signature.first);
-        auto func = _mgr[signature];
-        return func;
+        auto it = _mgr.find(signature);
+        CHECK(it != _mgr.end(), "can not find funciton name  " + symbol_name(signature.first));
+        return it->second;
     }
 
-    void register_func(std::string name, std::vector<std::string> args_name, FuncNode* func_node) {
+    // null when there is no such function
+    std::shared_ptr<Function> find_func(FunctionSignature signature) const {
+        auto it = _mgr.find(signature);
+        return it == _mgr.end() ? nullptr : it->second;
+    }
+
+    // a program's function shadows a builtin with the same signature
+    void register_func(SymbolId name, const std::vector<SymbolId>& args_name,
+                       FuncNode* func_node, CompileUnit* unit = nullptr) {
         FunctionSignature signature = {name, args_name.size()};
-        _mgr.insert({signature, std::make_shared<DefFunction>(func_node, args_name, signature)});
+        auto func = std::make_shared<DefFunction>(func_node, args_name, signature, unit);
+        if (is_built_in(signature)) {
+            _mgr[signature] = std::move(func);
+        } else {
+            _mgr.insert({signature, std::move(func)});
+        }
+    }
+
+    // hot reload: the function behind a signature is replaced or dropped, null drops it
+    void set_func(FunctionSignature signature, std::shared_ptr<Function> func) {
+        if (func) {
+            _mgr[signature] = std::move(func);
+        } else {
+            _mgr.erase(signature);
+        }
+    }
+
+    // the builtin with the signature, also when a program's function shadows it
+    std::shared_ptr<Function> find_built_in(FunctionSignature signature) const {
+        auto it = _built_ins.find(signature);
+        return it == _built_ins.end() ? nullptr : it->second;
     }
 
-    std::optional<FunctionSignature> get_func_signature(std::string name) {
+    bool is_built_in(FunctionSignature signature) const {
+        auto it = _mgr.find(signature);
+        return it != _mgr.end() && dynamic_cast<BuiltInFunction*>(it->second.get());
+    }
+
+    std::optional<FunctionSignature> get_func_signature(SymbolId name) {
         for (auto& [signature, _] : _mgr) {
             auto& [func_name, args] = signature;
             if (func_name == name) {
@@ -79,8 +122,15 @@ struct FunctionMgr {
 private:
     template <typename build_in_func>
     void register_built_in() {
-        FunctionSignature signature = {build_in_func::name, build_in_func::counter};
-        _mgr.insert({signature, std::make_shared<BuiltInFunction>(build_in_func::exec, signature)});
+        FunctionSignature signature = {intern(build_in_func::name), build_in_func::counter};
+        constexpr bool takes_ref = requires { build_in_func::takes_ref; };
+        auto func = std::make_shared<BuiltInFunction>(build_in_func::exec, signature, takes_ref);
+        _built_ins.insert({signature, func});
+        _mgr.insert({signature, std::move(func)});
     }
     void built_in_functions();
+
+    // every builtin, also the ones a program's function shadows
+    std::unordered_map<FunctionSignature, std::shared_ptr<Function>, FunctionSignatureHash>
+            _built_ins;
 };
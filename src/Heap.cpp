@@ -0,0 +1,185 @@
+#include "Heap.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <utility>
+#include <vector>
+
+#include "Map.h"
+#include "Value.h"
+
+namespace Heap {
+
+constinit bool watch_every_allocation = false;
+thread_local constinit bool watch_allocations = false;
+
+namespace {
+// objects one batch frees at most, a fraction of a millisecond
+constexpr size_t budget = 16384;
+// set by configure() before the other threads start, only read afterwards
+bool stats_enabled = false;
+bool stress = false;
+size_t max_objects = 0;
+// the counts below are kept
+bool counting = false;
+
+// objects of all threads: objects are freed on other threads than the one that made them, a
+// string a parser thread folds is freed by the program
+std::atomic<int64_t> alive = 0;
+std::atomic<int64_t> peak = 0;
+std::atomic<size_t> total_allocated = 0;
+std::atomic<size_t> total_freed = 0;
+
+void count_allocation() {
+    auto now = alive.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (!stats_enabled) return;
+    total_allocated.fetch_add(1, std::memory_order_relaxed);
+    auto most = peak.load(std::memory_order_relaxed);
+    while (now > most && !peak.compare_exchange_weak(most, now, std::memory_order_relaxed)) {
+    }
+}
+
+void count_frees(size_t n) {
+    alive.fetch_sub(int64_t(n), std::memory_order_relaxed);
+    if (stats_enabled) total_freed.fetch_add(n, std::memory_order_relaxed);
+}
+
+void destroy(HeapObject* object, Type type) {
+    switch (type) {
+    case Type::String:
+        delete static_cast<Shared<std::string>*>(object);
+        break;
+    case Type::Ref:
+        delete static_cast<Shared<ReferenceWrapping>*>(object);
+        break;
+    case Type::Arr:
+        delete static_cast<Shared<Array>*>(object);
+        break;
+    case Type::Struct:
+        delete static_cast<Shared<StructMembers>*>(object);
+        break;
+    case Type::Map:
+        delete static_cast<Shared<Map>*>(object);
+        break;
+    default:
+        break;
+    }
+}
+
+// release batches of one thread
+struct Stats {
+    // frees that let go of other objects, and the steps that freed queued objects later
+    size_t batches = 0;
+    double longest_ms = 0;
+    double total_ms = 0;
+};
+
+struct Queue {
+    // a thread that ends frees what it still has queued
+    ~Queue() {
+        while (!objects.empty()) release_batch(nullptr, Type::Int, SIZE_MAX);
+    }
+
+    // frees first, if any, then queued objects up to limit objects in all. the objects they
+    // let go of are queued, not freed from inside their destructors.
+    size_t free_objects(HeapObject* first, Type type, size_t limit) {
+        draining = true;
+        size_t n = 0;
+        if (first) {
+            destroy(first, type);
+            n++;
+        }
+        while (!objects.empty() && n < limit) {
+            auto [object, object_type] = objects.back();
+            objects.pop_back();
+            destroy(object, object_type);
+            n++;
+        }
+        draining = false;
+        if (counting) count_frees(n);
+        watch_allocations = !objects.empty();
+        return n;
+    }
+
+    void release_batch(HeapObject* first, Type type, size_t limit) {
+        if (!stats_enabled) {
+            free_objects(first, type, limit);
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        auto n = free_objects(first, type, limit);
+        // freeing a lone object is the common case and no batch
+        if (first && n == 1 && objects.empty()) return;
+        std::chrono::duration<double, std::milli> pause = std::chrono::steady_clock::now() - start;
+        stats.batches++;
+        stats.longest_ms = std::max(stats.longest_ms, pause.count());
+        stats.total_ms += pause.count();
+    }
+
+    std::vector<std::pair<HeapObject*, Type>> objects;
+    bool draining = false;
+    Stats stats;
+};
+
+thread_local Queue queue;
+
+size_t step_limit() {
+    return stress ? 1 : budget;
+}
+} // namespace
+
+void configure(bool stats, bool stress_mode, size_t max_alive) {
+    stats_enabled = stats;
+    stress = stress_mode;
+    max_objects = max_alive;
+    counting = stats || max_alive;
+    watch_every_allocation = stats || stress_mode || max_alive;
+}
+
+void on_allocation() {
+    if (counting) count_allocation();
+    if (!queue.draining && !queue.objects.empty()) {
+        queue.release_batch(nullptr, Type::Int, step_limit());
+    }
+    if (max_objects && alive.load(std::memory_order_relaxed) > int64_t(max_objects) &&
+        !queue.draining) {
+        // queued objects are garbage already, this thread frees its own at once. the other
+        // threads free theirs on their next allocations.
+        collect();
+        if (alive.load(std::memory_order_relaxed) > int64_t(max_objects)) {
+            std::cerr << "heap limit exceeded: more than " << max_objects
+                      << " objects alive, see --max-heap" << std::endl;
+            std::exit(1);
+        }
+    }
+}
+
+void release(HeapObject* object, Type type) {
+    if (queue.draining) {
+        queue.objects.emplace_back(object, type);
+        return;
+    }
+    queue.release_batch(object, type, step_limit());
+}
+
+void collect() {
+    while (!queue.objects.empty()) queue.release_batch(nullptr, Type::Int, budget);
+}
+
+std::string report() {
+    auto& stats = queue.stats;
+    std::stringstream out;
+    out.precision(3);
+    out << std::fixed << "gc: " << total_allocated << " objects allocated, " << total_freed
+        << " freed, at most " << peak << " alive; " << stats.batches
+        << " release batches, longest " << stats.longest_ms << " ms, " << stats.total_ms
+        << " ms in total";
+    return out.str();
+}
+
+} // namespace Heap
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+
+#include "Type.h"
+
+struct HeapObject;
+
+// frees heap objects once their count drops to zero. counting is enough here: values can not
+// form cycles, a write copies a shared object first, so no object ever comes to hold itself,
+// and a ref does not own the variable it points at. what freeing right away gets wrong is a
+// deep structure: deleting an object deletes its elements, a recursion as deep as the
+// structure. instead the objects a free lets go of are queued and freed in a loop, at most a
+// budget of them at a time; what is left over is freed a budget at a time by the next heap
+// allocations, so dropping a large structure does not stall the program either.
+// each thread has its own queue, parser threads fold strings while the program runs.
+namespace Heap {
+
+// stats: count allocations and time release batches for report(). stress: free at most one
+// queued object at a time, on every allocation. max_alive: when more objects are alive, on
+// all threads, the queue of the allocating thread is freed at once, and an error ends the
+// program if that is not enough; 0 for no limit. call before any other thread starts.
+void configure(bool stats, bool stress, size_t max_alive);
+
+// set by configure() when every allocation of every thread is counted or checked
+extern constinit bool watch_every_allocation;
+// whether this thread has queued objects to free on an allocation
+extern thread_local constinit bool watch_allocations;
+void on_allocation();
+// called for every heap object created
+inline void allocated() {
+    if (watch_every_allocation || watch_allocations) on_allocation();
+}
+
+// the count of object, of the given type, dropped to zero
+void release(HeapObject* object, Type type);
+// frees every queued object of this thread
+void collect();
+
+// counts of all threads and release batch pauses of this thread, for --gc-stats
+std::string report();
+
+} // namespace Heap
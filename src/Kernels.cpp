@@ -0,0 +1,310 @@
+#include "Kernels.h"
+
+#include <cstddef>
+#include <type_traits>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define KERNELS_AVX2 1
+#endif
+
+namespace Kernels {
+
+namespace {
+constexpr size_t lanes = 4;
+
+// integers wrap instead of overflowing
+int64_t wrap_add(int64_t a, int64_t b) {
+    return int64_t(uint64_t(a) + uint64_t(b));
+}
+int64_t wrap_mul(int64_t a, int64_t b) {
+    return int64_t(uint64_t(a) * uint64_t(b));
+}
+
+template <typename T>
+T add_op(T a, T b) {
+    if constexpr (std::is_integral_v<T>) {
+        return wrap_add(a, b);
+    } else {
+        return a + b;
+    }
+}
+template <typename T>
+T mul_op(T a, T b) {
+    if constexpr (std::is_integral_v<T>) {
+        return wrap_mul(a, b);
+    } else {
+        return a * b;
+    }
+}
+template <typename T>
+T min_op(T best, T x) {
+    return x < best ? x : best;
+}
+template <typename T>
+T max_op(T best, T x) {
+    return best < x ? x : best;
+}
+
+// the lanes combined as (0 + 1) + (2 + 3), then the elements from i on one by one
+template <typename T, typename Op>
+T finish(const T (&lane)[lanes], std::span<const T> a, size_t i, Op op) {
+    T r = op(op(lane[0], lane[1]), op(lane[2], lane[3]));
+    for (; i < a.size(); i++) r = op(r, a[i]);
+    return r;
+}
+
+template <typename T>
+T finish_dot(const T (&lane)[lanes], std::span<const T> a, std::span<const T> b, size_t i) {
+    T r = add_op(add_op(lane[0], lane[1]), add_op(lane[2], lane[3]));
+    for (; i < a.size(); i++) r = add_op(r, mul_op(a[i], b[i]));
+    return r;
+}
+
+namespace portable {
+
+template <typename T, typename Op>
+T reduce(std::span<const T> a, T init, Op op) {
+    T lane[lanes] = {init, init, init, init};
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) {
+        for (size_t j = 0; j < lanes; j++) lane[j] = op(lane[j], a[i + j]);
+    }
+    return finish(lane, a, i, op);
+}
+
+template <typename T>
+T dot(std::span<const T> a, std::span<const T> b) {
+    T lane[lanes] = {};
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) {
+        for (size_t j = 0; j < lanes; j++) lane[j] = add_op(lane[j], mul_op(a[i + j], b[i + j]));
+    }
+    return finish_dot(lane, a, b, i);
+}
+
+template <typename T, typename Op>
+void zip(std::span<const T> a, std::span<const T> b, std::span<T> out, Op op) {
+    for (size_t i = 0; i < a.size(); i++) out[i] = op(a[i], b[i]);
+}
+
+} // namespace portable
+
+#ifdef KERNELS_AVX2
+bool has_avx2() {
+    static const bool yes = __builtin_cpu_supports("avx2");
+    return yes;
+}
+
+namespace avx2 {
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 __m256i load(const int64_t* p) {
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+AVX2 __m256d load(const double* p) {
+    return _mm256_loadu_pd(p);
+}
+AVX2 void store(int64_t* p, __m256i v) {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+}
+AVX2 void store(double* p, __m256d v) {
+    _mm256_storeu_pd(p, v);
+}
+
+// the low 64 bits of each product, avx2 has no 64 bit multiply
+AVX2 __m256i mul64(__m256i a, __m256i b) {
+    auto low = _mm256_mul_epu32(a, b);
+    auto cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                  _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return _mm256_add_epi64(low, _mm256_slli_epi64(cross, 32));
+}
+
+AVX2 int64_t sum(std::span<const int64_t> a) {
+    auto acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) acc = _mm256_add_epi64(acc, load(&a[i]));
+    int64_t lane[lanes];
+    store(lane, acc);
+    return finish(lane, a, i, add_op<int64_t>);
+}
+
+AVX2 double sum(std::span<const double> a) {
+    auto acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) acc = _mm256_add_pd(acc, load(&a[i]));
+    double lane[lanes];
+    store(lane, acc);
+    return finish(lane, a, i, add_op<double>);
+}
+
+// _mm256_min_pd(x, best) is x < best ? x : best, the same as min_op
+AVX2 double min(std::span<const double> a) {
+    auto acc = _mm256_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) acc = _mm256_min_pd(load(&a[i]), acc);
+    double lane[lanes];
+    store(lane, acc);
+    return finish(lane, a, i, min_op<double>);
+}
+
+AVX2 double max(std::span<const double> a) {
+    auto acc = _mm256_set1_pd(a[0]);
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) acc = _mm256_max_pd(load(&a[i]), acc);
+    double lane[lanes];
+    store(lane, acc);
+    return finish(lane, a, i, max_op<double>);
+}
+
+AVX2 int64_t min(std::span<const int64_t> a) {
+    auto acc = _mm256_set1_epi64x(a[0]);
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) {
+        auto x = load(&a[i]);
+        acc = _mm256_blendv_epi8(acc, x, _mm256_cmpgt_epi64(acc, x));
+    }
+    int64_t lane[lanes];
+    store(lane, acc);
+    return finish(lane, a, i, min_op<int64_t>);
+}
+
+AVX2 int64_t max(std::span<const int64_t> a) {
+    auto acc = _mm256_set1_epi64x(a[0]);
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) {
+        auto x = load(&a[i]);
+        acc = _mm256_blendv_epi8(acc, x, _mm256_cmpgt_epi64(x, acc));
+    }
+    int64_t lane[lanes];
+    store(lane, acc);
+    return finish(lane, a, i, max_op<int64_t>);
+}
+
+AVX2 int64_t dot(std::span<const int64_t> a, std::span<const int64_t> b) {
+    auto acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) {
+        acc = _mm256_add_epi64(acc, mul64(load(&a[i]), load(&b[i])));
+    }
+    int64_t lane[lanes];
+    store(lane, acc);
+    return finish_dot(lane, a, b, i);
+}
+
+// a separate multiply and add, a fused one would round differently from the portable loop
+AVX2 double dot(std::span<const double> a, std::span<const double> b) {
+    auto acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) {
+        acc = _mm256_add_pd(acc, _mm256_mul_pd(load(&a[i]), load(&b[i])));
+    }
+    double lane[lanes];
+    store(lane, acc);
+    return finish_dot(lane, a, b, i);
+}
+
+AVX2 void add(std::span<const int64_t> a, std::span<const int64_t> b, std::span<int64_t> out) {
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) {
+        store(&out[i], _mm256_add_epi64(load(&a[i]), load(&b[i])));
+    }
+    for (; i < a.size(); i++) out[i] = wrap_add(a[i], b[i]);
+}
+
+AVX2 void add(std::span<const double> a, std::span<const double> b, std::span<double> out) {
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) {
+        store(&out[i], _mm256_add_pd(load(&a[i]), load(&b[i])));
+    }
+    for (; i < a.size(); i++) out[i] = a[i] + b[i];
+}
+
+AVX2 void mul(std::span<const int64_t> a, std::span<const int64_t> b, std::span<int64_t> out) {
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) {
+        store(&out[i], mul64(load(&a[i]), load(&b[i])));
+    }
+    for (; i < a.size(); i++) out[i] = wrap_mul(a[i], b[i]);
+}
+
+AVX2 void mul(std::span<const double> a, std::span<const double> b, std::span<double> out) {
+    size_t i = 0;
+    for (; i + lanes <= a.size(); i += lanes) {
+        store(&out[i], _mm256_mul_pd(load(&a[i]), load(&b[i])));
+    }
+    for (; i < a.size(); i++) out[i] = a[i] * b[i];
+}
+
+#undef AVX2
+} // namespace avx2
+#define DISPATCH(call)                    \
+    if (has_avx2()) return avx2::call;
+#else
+#define DISPATCH(call)
+#endif
+} // namespace
+
+int64_t sum(std::span<const int64_t> a) {
+    DISPATCH(sum(a))
+    return portable::reduce(a, int64_t(0), add_op<int64_t>);
+}
+
+double sum(std::span<const double> a) {
+    DISPATCH(sum(a))
+    return portable::reduce(a, 0.0, add_op<double>);
+}
+
+int64_t min(std::span<const int64_t> a) {
+    DISPATCH(min(a))
+    return portable::reduce(a, a[0], min_op<int64_t>);
+}
+
+double min(std::span<const double> a) {
+    DISPATCH(min(a))
+    return portable::reduce(a, a[0], min_op<double>);
+}
+
+int64_t max(std::span<const int64_t> a) {
+    DISPATCH(max(a))
+    return portable::reduce(a, a[0], max_op<int64_t>);
+}
+
+double max(std::span<const double> a) {
+    DISPATCH(max(a))
+    return portable::reduce(a, a[0], max_op<double>);
+}
+
+int64_t dot(std::span<const int64_t> a, std::span<const int64_t> b) {
+    DISPATCH(dot(a, b))
+    return portable::dot(a, b);
+}
+
+double dot(std::span<const double> a, std::span<const double> b) {
+    DISPATCH(dot(a, b))
+    return portable::dot(a, b);
+}
+
+void add(std::span<const int64_t> a, std::span<const int64_t> b, std::span<int64_t> out) {
+    DISPATCH(add(a, b, out))
+    portable::zip(a, b, out, add_op<int64_t>);
+}
+
+void add(std::span<const double> a, std::span<const double> b, std::span<double> out) {
+    DISPATCH(add(a, b, out))
+    portable::zip(a, b, out, add_op<double>);
+}
+
+void mul(std::span<const int64_t> a, std::span<const int64_t> b, std::span<int64_t> out) {
+    DISPATCH(mul(a, b, out))
+    portable::zip(a, b, out, mul_op<int64_t>);
+}
+
+void mul(std::span<const double> a, std::span<const double> b, std::span<double> out) {
+    DISPATCH(mul(a, b, out))
+    portable::zip(a, b, out, mul_op<double>);
+}
+
+#undef DISPATCH
+
+} // namespace Kernels
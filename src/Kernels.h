@@ -0,0 +1,31 @@
+#pragma once
+#include <cstdint>
+#include <span>
+
+// loops over unboxed array buffers. on x86-64 each kernel picks an AVX2 version at run time
+// when the cpu has it; the portable version keeps four lanes the same way, so a float sum gives
+// the same bits on every machine: lane i adds elements i, i + 4, ..., the lanes are then added
+// as (0 + 1) + (2 + 3) and the tail last. integers wrap on overflow.
+namespace Kernels {
+
+int64_t sum(std::span<const int64_t> a);
+double sum(std::span<const double> a);
+
+// a must not be empty. a NaN is skipped unless it is the first element, like a scalar
+// "if (x < best) best = x" loop.
+int64_t min(std::span<const int64_t> a);
+double min(std::span<const double> a);
+int64_t max(std::span<const int64_t> a);
+double max(std::span<const double> a);
+
+// a and b have the same size, products are summed like sum()
+int64_t dot(std::span<const int64_t> a, std::span<const int64_t> b);
+double dot(std::span<const double> a, std::span<const double> b);
+
+// out[i] = a[i] op b[i], all three have the same size
+void add(std::span<const int64_t> a, std::span<const int64_t> b, std::span<int64_t> out);
+void add(std::span<const double> a, std::span<const double> b, std::span<double> out);
+void mul(std::span<const int64_t> a, std::span<const int64_t> b, std::span<int64_t> out);
+void mul(std::span<const double> a, std::span<const double> b, std::span<double> out);
+
+} // namespace Kernels
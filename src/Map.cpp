@@ -0,0 +1,171 @@
+#include "Map.h"
+
+#include <bit>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+constexpr size_t group_size = 16;
+// a full slot holds the low 7 bits of the hash, the free ones have the high bit set
+constexpr int8_t empty = -128;
+constexpr int8_t erased = -2;
+
+// one bit per control byte of a group, bit j for slot j
+struct Group {
+    explicit Group(const int8_t* ctrl) : ctrl(ctrl) {}
+
+#if defined(__SSE2__)
+    uint32_t match(int8_t h2) const {
+        auto bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(h2)));
+    }
+    // empty or erased
+    uint32_t match_free() const {
+        return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)));
+    }
+#else
+    uint32_t match(int8_t h2) const {
+        uint32_t bits = 0;
+        for (size_t j = 0; j < group_size; j++) bits |= uint32_t(ctrl[j] == h2) << j;
+        return bits;
+    }
+    uint32_t match_free() const {
+        uint32_t bits = 0;
+        for (size_t j = 0; j < group_size; j++) bits |= uint32_t(ctrl[j] < 0) << j;
+        return bits;
+    }
+#endif
+    uint32_t match_empty() const { return match(empty); }
+
+    const int8_t* ctrl;
+};
+
+// an int is its own hash, spread by a multiply so keys that differ only in high bits still
+// land in different groups; a string is hashed by its text, which an interned one keeps
+uint64_t hash_key(const Value& key) {
+    uint64_t h;
+    if (key.type() == Type::Int) {
+        h = uint64_t(key.as_int());
+    } else {
+        CHECK(key.is_str(), "map key must be an int or a string, now is " +
+                                    type_to_str(key.type()));
+        h = key.string_hash();
+    }
+    h *= 0x9e3779b97f4a7c15;
+    return h ^ (h >> 32);
+}
+
+int8_t h2(uint64_t hash) {
+    return int8_t(hash & 0x7f);
+}
+
+bool same_key(const Value& a, const Value& b) {
+    if (a.type() != b.type()) return false;
+    if (a.type() == Type::Int) return a.as_int() == b.as_int();
+    if (a.is_interned() && b.is_interned()) return &a.as_string() == &b.as_string();
+    return a.as_string() == b.as_string();
+}
+
+// the groups of a probe sequence: the group the hash picks, then 1, 2, 3, ... groups further,
+// which visits every group once when their count is a power of two
+struct Probe {
+    Probe(uint64_t hash, size_t groups) : mask(groups - 1), group((hash >> 7) & mask) {}
+    size_t first_slot() const { return group * group_size; }
+    void next() { group = (group + ++step) & mask; }
+
+    size_t mask;
+    size_t group;
+    size_t step = 0;
+};
+} // namespace
+
+Value Map::entry(size_t i) const {
+    static const Shape* shape = Shape::empty()->add(intern("key"))->add(intern("value"));
+    return Value::make_Struct({shape, {_entries[i].key, _entries[i].value}});
+}
+
+const Value* Map::find(const Value& key) const {
+    auto slot = find_slot(hash_key(key), key);
+    return slot == npos ? nullptr : &_entries[_slots[slot]].value;
+}
+
+Value& Map::operator[](const Value& key) {
+    auto hash = hash_key(key);
+    auto slot = find_slot(hash, key);
+    if (slot != npos) return _entries[_slots[slot]].value;
+    // at most 7 of 8 slots in use, so every probe sequence meets an empty slot
+    if ((_used + 1) * 8 > _ctrl.size() * 7) rehash();
+    _entries.push_back({hash, key, Value()});
+    place(_entries.size() - 1);
+    return _entries.back().value;
+}
+
+bool Map::erase(const Value& key) {
+    auto slot = find_slot(hash_key(key), key);
+    if (slot == npos) return false;
+    // a group that has an empty slot was never full, no probe sequence went on past it, so
+    // the slot can be empty again. otherwise lookups have to step over it.
+    if (Group(&_ctrl[slot / group_size * group_size]).match_empty()) {
+        _ctrl[slot] = empty;
+        _used--;
+    } else {
+        _ctrl[slot] = erased;
+    }
+    size_t i = _slots[slot];
+    size_t last = _entries.size() - 1;
+    if (i != last) {
+        _slots[slot_of(last)] = i;
+        _entries[i] = std::move(_entries[last]);
+    }
+    _entries.pop_back();
+    return true;
+}
+
+size_t Map::find_slot(uint64_t hash, const Value& key) const {
+    if (_ctrl.empty()) return npos;
+    for (Probe probe(hash, _ctrl.size() / group_size);; probe.next()) {
+        Group group(&_ctrl[probe.first_slot()]);
+        for (auto bits = group.match(h2(hash)); bits; bits &= bits - 1) {
+            size_t slot = probe.first_slot() + std::countr_zero(bits);
+            auto& entry = _entries[_slots[slot]];
+            if (entry.hash == hash && same_key(entry.key, key)) return slot;
+        }
+        if (group.match_empty()) return npos;
+    }
+}
+
+size_t Map::slot_of(size_t i) const {
+    auto hash = _entries[i].hash;
+    for (Probe probe(hash, _ctrl.size() / group_size);; probe.next()) {
+        Group group(&_ctrl[probe.first_slot()]);
+        for (auto bits = group.match(h2(hash)); bits; bits &= bits - 1) {
+            size_t slot = probe.first_slot() + std::countr_zero(bits);
+            if (_slots[slot] == i) return slot;
+        }
+    }
+}
+
+void Map::place(size_t i) {
+    auto hash = _entries[i].hash;
+    for (Probe probe(hash, _ctrl.size() / group_size);; probe.next()) {
+        auto bits = Group(&_ctrl[probe.first_slot()]).match_free();
+        if (!bits) continue;
+        size_t slot = probe.first_slot() + std::countr_zero(bits);
+        if (_ctrl[slot] == empty) _used++;
+        _ctrl[slot] = h2(hash);
+        _slots[slot] = i;
+        return;
+    }
+}
+
+void Map::rehash() {
+    // at most 7 of 16 slots in use afterwards, the erased slots are gone
+    size_t slots = group_size;
+    while ((_entries.size() + 1) * 16 > slots * 7) slots *= 2;
+    _ctrl.assign(slots, empty);
+    _slots.assign(slots, 0);
+    _used = 0;
+    for (size_t i = 0; i < _entries.size(); i++) place(i);
+}
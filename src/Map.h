@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include "Value.h"
+
+// a map value from int or string keys to values. the entries are kept in insertion order in
+// one vector and found through an open addressing index in the style of a Swiss table: one
+// control byte per slot holds 7 bits of the hash of the entry in the slot, or marks the slot
+// empty or erased, and a lookup compares a group of 16 control bytes at once (with SSE2 on
+// x86-64), so it looks at an entry only when those 7 bits match. every entry keeps the hash of
+// its key: a string is hashed once when it is added, never again when the index grows, and
+// an interned string, what a constant key is, carries its hash from the start.
+struct Map {
+    struct Entry {
+        uint64_t hash;
+        Value key;
+        Value value;
+    };
+
+    size_t size() const { return _entries.size(); }
+    const std::vector<Entry>& entries() const { return _entries; }
+    // entry i as a struct with the members key and value, what foreach gives
+    Value entry(size_t i) const;
+
+    // the value under key, nullptr when key is missing
+    const Value* find(const Value& key) const;
+    // the value under key for writing, a missing key is added with the default value. valid
+    // until the next key is added or erased.
+    Value& operator[](const Value& key);
+    // false when key was missing. the last entry takes the place of the erased one.
+    bool erase(const Value& key);
+
+private:
+    constexpr static size_t npos = SIZE_MAX;
+
+    // the slot of the entry with this key, npos when there is none
+    size_t find_slot(uint64_t hash, const Value& key) const;
+    // the slot that holds entry position i
+    size_t slot_of(size_t i) const;
+    // puts entry position i in the first free slot of its probe sequence
+    void place(size_t i);
+    // a new index for the entries, with room to add as many again
+    void rehash();
+
+    std::vector<Entry> _entries;
+    // one control byte and one entry position per slot, the slot count is a power of two
+    std::vector<int8_t> _ctrl;
+    std::vector<uint32_t> _slots;
+    // slots that are not empty: the full ones and the erased ones
+    size_t _used = 0;
+};
+
+inline const Map& Value::get_map() const {
+    auto& v = deref();
+    CHECK(v.is_map(), "must be a map, now is " + type_to_str(v.type()));
+    return v._map->data;
+}
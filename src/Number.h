@@ -0,0 +1,88 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <concepts>
+#include <cstdlib>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+// number <-> text without streams or allocations: std::from_chars to read, std::to_chars to
+// write. floats are written in the shortest form that reads back to the same double.
+namespace Number {
+
+// the whole text must be the number
+inline std::optional<int64_t> parse_int(std::string_view s) {
+    int64_t value;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (ec != std::errc() || end != s.data() + s.size()) return std::nullopt;
+    return value;
+}
+
+// a value too small for a double reads as 0, one too large is an error
+inline std::optional<double> parse_float(std::string_view s) {
+    double value;
+    auto [end, ec] = std::from_chars(s.data(), s.data() + s.size(), value);
+    if (end != s.data() + s.size()) return std::nullopt;
+    if (ec == std::errc::result_out_of_range) {
+        // rare, strtod tells the underflow from the overflow
+        value = std::strtod(std::string(s).c_str(), nullptr);
+        if (std::isinf(value)) return std::nullopt;
+    } else if (ec != std::errc()) {
+        return std::nullopt;
+    }
+    return value;
+}
+
+// like std::stoll: leading blanks and trailing text are ignored
+inline std::optional<int64_t> parse_leading_int(std::string_view s) {
+    auto begin = s.find_first_not_of(" \t\n\v\f\r");
+    if (begin == std::string_view::npos) return std::nullopt;
+    if (s[begin] == '+') begin++;
+    int64_t value;
+    auto [_, ec] = std::from_chars(s.data() + begin, s.data() + s.size(), value);
+    if (ec != std::errc()) return std::nullopt;
+    return value;
+}
+
+// appends the text form: integers and bools as decimal, floats shortest round trip like
+// python's repr: fixed notation from 1e-4 up to 1e16, with a ".0" kept on whole values so they
+// still read as floats, and an exponent outside that range. the exponent has no '+', what a
+// constant in the source can not have either.
+template <typename T>
+    requires std::integral<T> || std::floating_point<T>
+void append(std::string& out, T value) {
+    // enough for any int64 and for the longest shortest-form double, 0.0001 and 17 digits
+    char buffer[32];
+    char* end;
+    if constexpr (std::floating_point<T>) {
+        double x = value;
+        double magnitude = std::fabs(x);
+        if (magnitude == 0 || (magnitude >= 1e-4 && magnitude < 1e16)) {
+            end = std::to_chars(buffer, buffer + sizeof(buffer), x, std::chars_format::fixed).ptr;
+            if (std::string_view(buffer, end - buffer).find('.') == std::string_view::npos) {
+                *end++ = '.';
+                *end++ = '0';
+            }
+        } else {
+            end = std::to_chars(buffer, buffer + sizeof(buffer), x, std::chars_format::scientific)
+                          .ptr;
+            auto* plus = std::find(buffer, end, '+');
+            if (plus != end) end = std::copy(plus + 1, end, plus);
+        }
+    } else {
+        end = std::to_chars(buffer, buffer + sizeof(buffer), int64_t(value)).ptr;
+    }
+    out.append(buffer, end);
+}
+
+template <typename T>
+std::string to_string(T value) {
+    std::string out;
+    append(out, value);
+    return out;
+}
+
+} // namespace Number
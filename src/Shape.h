@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include "Symbol.h"
+
+// the layout of a struct value: its member names in slot order. shapes form a tree rooted at
+// the empty shape, adding a member moves a value to the child shape for that member, so
+// structs declared or grown the same way share one shape and a shape pointer identifies a
+// layout. shapes are never freed and are only created on the thread running the program.
+struct Shape {
+    constexpr static uint32_t npos = UINT32_MAX;
+
+    static const Shape* empty() {
+        static Shape root;
+        return &root;
+    }
+
+    const std::vector<SymbolId>& members() const { return _members; }
+    size_t size() const { return _members.size(); }
+
+    // slot of the member, npos when the shape has no such member. structs are small, a scan
+    // beats hashing; member access caches the result per shape anyway.
+    uint32_t slot(SymbolId name) const {
+        for (uint32_t i = 0; i < _members.size(); i++) {
+            if (_members[i] == name) return i;
+        }
+        return npos;
+    }
+
+    // this shape with name appended as the last slot
+    const Shape* add(SymbolId name) const {
+        auto& next = _transitions[name];
+        if (!next) {
+            next.reset(new Shape);
+            next->_members = _members;
+            next->_members.push_back(name);
+        }
+        return next.get();
+    }
+
+private:
+    Shape() = default;
+    Shape(const Shape&) = delete;
+    void operator=(const Shape&) = delete;
+
+    std::vector<SymbolId> _members;
+    mutable std::unordered_map<SymbolId, std::unique_ptr<Shape>> _transitions;
+};
+
+// where a member access found its member last time: the slot is valid for values of that
+// shape
+struct MemberCache {
+    const Shape* shape = nullptr;
+    uint32_t slot = 0;
+};
@@ -0,0 +1,49 @@
+#include "SourceFile.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <utility>
+
+SourceFile::SourceFile(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return;
+    }
+    const size_t size = st.st_size;
+    const size_t page = ::sysconf(_SC_PAGESIZE);
+    // reserve one zero page more than the file needs, then map the file over the front of
+    // it. the sentinel page stays, even when the size is an exact multiple of the page size.
+    const size_t mapped_size = (size + page - 1) / page * page + page;
+    void* base = ::mmap(nullptr, mapped_size, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        ::close(fd);
+        return;
+    }
+    if (size > 0) {
+        if (::mmap(base, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+            ::munmap(base, mapped_size);
+            ::close(fd);
+            return;
+        }
+        ::madvise(base, size, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    _data = static_cast<const char*>(base);
+    _size = size;
+    _mapped_size = mapped_size;
+}
+
+SourceFile::~SourceFile() {
+    if (_data) ::munmap(const_cast<char*>(_data), _mapped_size);
+}
+
+SourceFile::SourceFile(SourceFile&& rhs) noexcept
+        : _data(std::exchange(rhs._data, nullptr)),
+          _size(std::exchange(rhs._size, 0)),
+          _mapped_size(std::exchange(rhs._mapped_size, 0)) {}
@@ -0,0 +1,22 @@
+#pragma once
+#include <filesystem>
+#include <string_view>
+
+// read-only view of a source file, mapped straight from the page cache instead of being
+// copied through streams and strings. the mapping is always followed by at least one '\0'
+// byte, which the tokenizer uses as its end sentinel.
+struct SourceFile {
+    SourceFile(const std::filesystem::path& path);
+    ~SourceFile();
+    SourceFile(SourceFile&& rhs) noexcept;
+    SourceFile(const SourceFile&) = delete;
+    void operator=(const SourceFile&) = delete;
+
+    bool is_open() const { return _data != nullptr; }
+    std::string_view text() const { return {_data, _size}; }
+
+private:
+    const char* _data = nullptr;
+    size_t _size = 0;
+    size_t _mapped_size = 0;
+};
@@ -0,0 +1,63 @@
+#include "Symbol.h"
+
+#include "util.h"
+
+SymbolTable& SymbolTable::instance() {
+    static SymbolTable table;
+    return table;
+}
+
+SymbolId SymbolTable::intern(std::string_view name) {
+    {
+        std::shared_lock lock(_mutex);
+        if (auto it = _ids.find(name); it != _ids.end()) {
+            return it->second;
+        }
+    }
+    std::unique_lock lock(_mutex);
+    // another thread may have added it between the two locks
+    if (auto it = _ids.find(name); it != _ids.end()) {
+        return it->second;
+    }
+    SymbolId id = _names.size();
+    const auto& stored = _names.emplace_back(name);
+    _ids.emplace(stored, id);
+    return id;
+}
+
+const std::string& SymbolTable::name(SymbolId id) const {
+    std::shared_lock lock(_mutex);
+    CHECK(id < _names.size(), "unknown symbol id " + std::to_string(id));
+    return _names[id];
+}
+
+size_t SymbolTable::size() const {
+    std::shared_lock lock(_mutex);
+    return _names.size();
+}
+
+size_t SymbolTable::memory_usage() const {
+    std::shared_lock lock(_mutex);
+    size_t bytes = sizeof(*this);
+    for (const auto& name : _names) {
+        bytes += sizeof(std::string);
+        // short names live inside the string object itself
+        if (name.capacity() > std::string().capacity()) bytes += name.capacity() + 1;
+    }
+    // one node per entry plus the bucket array
+    bytes += _ids.size() * (sizeof(std::pair<const std::string_view, SymbolId>) + sizeof(void*) * 2);
+    bytes += _ids.bucket_count() * sizeof(void*);
+    return bytes;
+}
+
+std::string SymbolTable::memory_report() const {
+    size_t name_bytes = 0;
+    {
+        std::shared_lock lock(_mutex);
+        for (const auto& name : _names) name_bytes += name.size();
+    }
+    std::stringstream out;
+    out << "symbols: " << size() << " interned, " << name_bytes << " bytes of names, "
+        << memory_usage() << " bytes total";
+    return out.str();
+}
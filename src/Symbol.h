@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+// identifiers are interned once by the tokenizer, everything after that compares and hashes
+// the dense integer id instead of the string. files are tokenized on several threads, so the
+// table is guarded by a reader/writer lock; ids depend on interning order and are only
+// meaningful within one run.
+using SymbolId = uint32_t;
+
+struct SymbolTable {
+    constexpr static SymbolId invalid_id = UINT32_MAX;
+
+    static SymbolTable& instance();
+
+    SymbolId intern(std::string_view name);
+    const std::string& name(SymbolId id) const;
+
+    size_t size() const;
+    // approximate bytes held by the table: the names, their string objects and the index
+    size_t memory_usage() const;
+    std::string memory_report() const;
+
+private:
+    SymbolTable() = default;
+    SymbolTable(const SymbolTable&) = delete;
+    void operator=(const SymbolTable&) = delete;
+
+    mutable std::shared_mutex _mutex;
+    // deque keeps the strings in place, so the string_view keys below stay valid
+    std::deque<std::string> _names;
+    std::unordered_map<std::string_view, SymbolId> _ids;
+};
+
+inline SymbolId intern(std::string_view name) {
+    return SymbolTable::instance().intern(name);
+}
+
+inline const std::string& symbol_name(SymbolId id) {
+    return SymbolTable::instance().name(id);
+}
@@ -0,0 +1,53 @@
+#include "ThreadPool.h"
+
+ThreadPool::ThreadPool(size_t threads) {
+    for (size_t i = 1; i < threads; i++) {
+        _workers.emplace_back([this] { worker_loop(); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(_mutex);
+        _stop = true;
+    }
+    _wake.notify_all();
+    for (auto& worker : _workers) worker.join();
+}
+
+void ThreadPool::parallel_for(size_t n, const std::function<void(size_t)>& fn) {
+    {
+        std::lock_guard lock(_mutex);
+        _fn = &fn;
+        _task_count = n;
+        _next_task = 0;
+        _busy_workers = _workers.size();
+        _generation++;
+    }
+    _wake.notify_all();
+    run_tasks();
+    std::unique_lock lock(_mutex);
+    _done.wait(lock, [this] { return _busy_workers == 0; });
+    _fn = nullptr;
+}
+
+void ThreadPool::worker_loop() {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            std::unique_lock lock(_mutex);
+            _wake.wait(lock, [&] { return _stop || _generation != seen; });
+            if (_stop) return;
+            seen = _generation;
+        }
+        run_tasks();
+        std::lock_guard lock(_mutex);
+        if (--_busy_workers == 0) _done.notify_one();
+    }
+}
+
+void ThreadPool::run_tasks() {
+    for (size_t i = _next_task++; i < _task_count; i = _next_task++) {
+        (*_fn)(i);
+    }
+}
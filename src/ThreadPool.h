@@ -0,0 +1,41 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// a fixed set of worker threads for the startup work (parsing files, preparing functions).
+// the calling thread works too, so a pool of size 1 runs everything inline.
+struct ThreadPool {
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    void operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return _workers.size() + 1; }
+
+    // calls fn(0) ... fn(n - 1) spread over the pool and returns when all calls are done.
+    // fn must not throw.
+    void parallel_for(size_t n, const std::function<void(size_t)>& fn);
+
+    static size_t default_size() { return std::max(1u, std::thread::hardware_concurrency()); }
+
+private:
+    void worker_loop();
+    void run_tasks();
+
+    std::vector<std::thread> _workers;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(size_t)>* _fn = nullptr;
+    size_t _task_count = 0;
+    std::atomic<size_t> _next_task = 0;
+    size_t _busy_workers = 0;
+    uint64_t _generation = 0;
+    bool _stop = false;
+};
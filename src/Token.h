@@ -1,10 +1,48 @@
 
 #pragma once
+#include <array>
 #include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
 #include <vector>
 
+#include "Symbol.h"
 #include "Type.h"
 #include "util.h"
+
+// same order as Token::ops, Subscript is the postfix [ ]
+enum class OpKind : uint8_t {
+    Add = 0,
+    Sub,
+    Mul,
+    Div,
+    Equal,
+    NotEqual,
+    Assign,
+    Member,
+    LessOrEqual,
+    GreaterOrEqual,
+    Less,
+    Greater,
+    And,
+    Or,
+    Ref,
+    Arr,
+    Let,
+    Subscript,
+    None,
+};
+
+enum class Assoc : uint8_t { Left, Right };
+
+struct OpInfo {
+    int priority;
+    int arity;
+    Assoc assoc;
+};
+
 struct Token {
     constexpr static std::string_view key_words[] = {
             "if", "while", "for", "def", "return", "struct", "extends", "else", "foreach"};
@@ -18,7 +56,35 @@ struct Token {
     constexpr static int prioritys[] = {-6, -6, -5, -5,  -9,  -9, -15, -2, -8,
                                         -8, -8, -8, -13, -14, -3, -3,  -3};
     static_assert(sizeof(ops) / sizeof(std::string_view) == sizeof(prioritys) / sizeof(int));
-    enum Type {
+
+    constexpr static std::string_view prefix_ops[] = {"&", "arr", "let"};
+
+    constexpr static size_t op_kind_count = size_t(OpKind::None);
+    static_assert(std::size(ops) == size_t(OpKind::Subscript));
+
+    constexpr static OpKind op_kind_of(std::string_view s) {
+        for (size_t i = 0; i < std::size(ops); i++) {
+            if (ops[i] == s) return OpKind(i);
+        }
+        return OpKind::None;
+    }
+
+    constexpr static auto op_infos = []() {
+        std::array<OpInfo, op_kind_count> infos {};
+        for (size_t i = 0; i < std::size(ops); i++) {
+            bool prefix = std::find(std::begin(prefix_ops), std::end(prefix_ops), ops[i]) !=
+                          std::end(prefix_ops);
+            infos[i].priority = prioritys[i];
+            infos[i].arity = prefix ? 1 : 2;
+            infos[i].assoc = prefix || ops[i] == "=" ? Assoc::Right : Assoc::Left;
+        }
+        infos[size_t(OpKind::Subscript)] = {infos[size_t(OpKind::Member)].priority, 2, Assoc::Left};
+        return infos;
+    }();
+
+    constexpr static const OpInfo& op_info(OpKind kind) { return op_infos[size_t(kind)]; }
+
+    enum Type : uint8_t {
         key_word = 0, // if while for def (  {
         variable,
         constant,
@@ -27,6 +93,10 @@ struct Token {
 
     };
 
+    // what a constant looked like while it was scanned. integer is digits only, decimal has a
+    // '.' or an exponent and is read as a float, a malformed constant reads as the default.
+    enum class Literal : uint8_t { none, integer, decimal, string, malformed };
+
     static std::string token_type_string(Type type) {
         switch (type) {
         case key_word:
@@ -44,176 +114,398 @@ struct Token {
         }
     }
 
-    Token(const std::string& s, Token::Type type) : _str(s), _type(type) {}
-    Token(const Token& rhs) = default;
-    Token() {}
+    // a token is a view into the source buffer (or into the static tables above for
+    // keywords, operators and brackets), so the source must outlive the token stream.
+    constexpr Token(std::string_view s, Token::Type type, SymbolId symbol = SymbolTable::invalid_id)
+            : _str(s), _type(type), _symbol(symbol) {}
+    constexpr Token(OpKind kind, std::string_view s, Token::Type type)
+            : _str(s), _type(type), _op_kind(kind) {}
+    constexpr Token(std::string_view s, Literal literal)
+            : _str(s), _type(constant), _literal(literal) {}
+    constexpr Token() = default;
     Type type() const { return _type; }
-    std::string str() const { return _str; }
+    std::string_view str() const { return _str; }
+    // interned name of a variable token
+    SymbolId symbol() const { return _symbol; }
+    // set by the tokenizer for operators and for [
+    OpKind op_kind() const { return _op_kind; }
+    Literal literal() const { return _literal; }
 
     int priority() const {
-        int idx = 0;
-        for (auto op : ops) {
-            if (_str == op) return prioritys[idx];
-            idx++;
-        }
-        if (_str == "[") return -2;
-        CHECK(0, "should not reach here.");
-        return -20;
+        CHECK(_op_kind != OpKind::None, "should not reach here.");
+        return op_info(_op_kind).priority;
+    }
+
+    // whether the operator on top of the stack is reduced before this one is pushed
+    bool reduce_before(const Token& top) const {
+        auto top_priority = top.priority();
+        return top_priority > priority() ||
+               (top_priority == priority() && op_info(_op_kind).assoc == Assoc::Left);
     }
 
 private:
-    std::string _str;
-    Type _type;
+    std::string_view _str;
+    Type _type = key_word;
+    SymbolId _symbol = SymbolTable::invalid_id;
+    OpKind _op_kind = OpKind::None;
+    Literal _literal = Literal::none;
 };
 
-inline static auto token_from_str_map = [](
-
-                                        ) {
-    std::map<std::string, Token> map;
-    for (auto& s : Token::key_words) {
-        map.insert({std::string {s}, Token(std::string {s}, Token::Type::key_word)});
-    }
-    for (auto& s : Token::ops) {
-        map.insert({std::string {s}, Token(std::string {s}, Token::Type::op)});
-    }
-    for (auto& s : Token::brackets) {
-        map.insert({std::string {s}, Token(std::string {s}, Token::Type::bracket)});
+// the token the tokenizer emits for each operator, indexed by OpKind
+inline constexpr auto op_tokens = []() {
+    std::array<Token, Token::op_kind_count> tokens {};
+    for (size_t i = 0; i < std::size(Token::ops); i++) {
+        tokens[i] = Token(OpKind(i), Token::ops[i], Token::Type::op);
     }
-    return map;
+    tokens[size_t(OpKind::Subscript)] = Token(OpKind::Subscript, "[", Token::Type::bracket);
+    return tokens;
 }();
 
+static_assert(Token::op_kind_of("==") == OpKind::Equal && Token::op_kind_of("=") == OpKind::Assign &&
+              Token::op_kind_of("&") == OpKind::Ref && Token::op_kind_of("let") == OpKind::Let);
+
 inline bool operator==(const Token& l, const Token& r) {
     return l.type() == r.type() && l.str() == r.str();
 }
 
+// raised for malformed source, the message starts with "line:column: "
+struct ParseError : std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+inline std::string source_position(std::string_view source, size_t offset) {
+    size_t line = 1, column = 1;
+    for (size_t i = 0; i < offset && i < source.size(); i++) {
+        if (source[i] == '\n') {
+            line++;
+            column = 1;
+        } else {
+            column++;
+        }
+    }
+    return std::to_string(line) + ":" + std::to_string(column);
+}
+
+[[noreturn]] inline void parse_error(std::string_view source, size_t offset,
+                                     const std::string& info) {
+    throw ParseError(source_position(source, offset) + ": " + info);
+}
+
+// tokens are produced a chunk at a time while the parser consumes them, so only a small
+// window of the file's tokens is ever held in memory.
 struct TokenStream {
-    TokenStream(const std::vector<Token> tokens) : _tokens(tokens) {}
+    constexpr static size_t chunk_tokens = 1024;
+
+    // source must be followed by a '\0' byte, see Tokenizer::tokenize. tokens start at begin,
+    // positions in errors are still counted from the start of source.
+    TokenStream(std::string_view source, size_t begin = 0) : _scan_pos(begin), _source(source) {
+        _tokens.reserve(chunk_tokens);
+    }
+    TokenStream(TokenStream&&) = default;
+    TokenStream(const TokenStream&) = delete;
 
+    // returned by value, the buffer behind top() is reused once the chunk is consumed
     Token get() {
-        CHECK(_cur_pos < _tokens.size(), "out of bound");
-        return _tokens[_cur_pos++];
+        Token token = top();
+        _cur_pos++;
+        return token;
     }
-    Token top() {
-        CHECK(_cur_pos < _tokens.size(), "out of bound");
+    // valid until the next get()
+    const Token& top() {
+        if (_cur_pos == _tokens.size() && !refill()) error_at_end("unexpected end of file");
         return _tokens[_cur_pos];
     }
-    bool end() { return _cur_pos == _tokens.size(); }
-    Token eat(const std::string& s) {
-        Token token = token_from_str_map[s];
-        return eat(token);
+    bool end() { return _cur_pos == _tokens.size() && !refill(); }
+
+    // s must be a keyword, operator or bracket
+    Token eat(std::string_view s) {
+        auto cur_token = get();
+        if (!is_punct(cur_token, s)) {
+            error(cur_token, "expected '" + std::string(s) + "' but found '" +
+                                     std::string(cur_token.str()) + "'");
+        }
+        return cur_token;
     }
 
-    Token eat(const Token token) {
+    Token eat(const Token& token) {
         auto cur_token = get();
-        CHECK(token == cur_token,
-              "eat token failed want eat  " + token.str() + " but now is " + cur_token.str());
+        if (!(token == cur_token)) {
+            error(cur_token, "expected '" + std::string(token.str()) + "' but found '" +
+                                     std::string(cur_token.str()) + "'");
+        }
         return cur_token;
     }
 
     Token eat(Token::Type type) {
         auto cur_token = get();
-        CHECK(cur_token.type() == type, "eat token failed want eat type" +
-                                                Token::token_type_string(type) + " but now is " +
-                                                Token::token_type_string(cur_token.type()));
+        if (cur_token.type() != type) {
+            error(cur_token, "expected " + Token::token_type_string(type) + " but found " +
+                                     Token::token_type_string(cur_token.type()) + " '" +
+                                     std::string(cur_token.str()) + "'");
+        }
         return cur_token;
     }
 
-    bool top_equal(const std::string s) {
-        Token token = token_from_str_map[s];
-        return token == top();
-    }
+    // lazy mode: skips the rest of a block whose '{' was just eaten, including the closing
+    // '}', without tokenizing it. returns the offset where the body starts.
+    size_t skip_block();
+
+    bool top_equal(std::string_view s) { return is_punct(top(), s); }
     bool top_equal(Token::Type type) { return type == top().type(); }
 
-    auto cur_pos() const { return _cur_pos; }
+    // every token is a view into the source, so its offset gives the line and column
+    size_t offset(const Token& token) const { return token.str().data() - _source.data(); }
 
-    std::string get_token_string(size_t begin, size_t end) {
-        std::string name;
-        for (int i = begin; i < end; i++) {
-            name += _tokens[i].str();
-        }
-        return name;
+    [[noreturn]] void error(const Token& token, const std::string& info) const {
+        parse_error(_source, offset(token), info);
+    }
+    [[noreturn]] void error_at_end(const std::string& info) const {
+        parse_error(_source, _source.size(), info);
     }
 
 private:
+    static bool is_punct(const Token& token, std::string_view s) {
+        return token.str() == s && token.type() != Token::Type::variable &&
+               token.type() != Token::Type::constant;
+    }
+
+    // tokenizes the next chunk into _tokens, false at the end of the source
+    bool refill();
+
     std::vector<Token> _tokens;
     size_t _cur_pos = 0;
+    // where the tokenizer continues in _source
+    size_t _scan_pos = 0;
+    // tokens per refill, smaller right after skip_block()
+    size_t _chunk = chunk_tokens;
+    std::string_view _source;
 };
 
 struct Tokenizer {
     static auto isvariable(char c) { return std::isalpha(c) || std::isdigit(c); }
 
-    static TokenStream get_token_stream(std::string text) {
-        std::vector<Token> tokens;
-        size_t pos = 0;
-        auto is_key_words = [&]() -> std::optional<std::string> {
-            for (auto& key_word : Token::key_words) {
-                if (text.substr(pos, key_word.size()) == key_word &&
-                    !isvariable(text[pos + key_word.size()])) {
-                    pos += key_word.size();
-                    return std::string(key_word);
-                }
-            }
-            return std::nullopt;
-        };
+    // every byte is classified once through this table instead of probing each keyword,
+    // operator and bracket with substr.
+    enum CharClass : uint8_t { other = 0, space, alpha, digit, quote, punct };
 
-        auto is_op_words = [&]() -> std::optional<std::string> {
-            for (auto& op : Token::ops) {
-                if (text.substr(pos, op.size()) == op) {
-                    pos += op.size();
-                    return std::string(op);
-                }
-            }
+    constexpr static auto char_class = []() {
+        std::array<uint8_t, 256> table {};
+        for (int c = 'a'; c <= 'z'; c++) table[c] = alpha;
+        for (int c = 'A'; c <= 'Z'; c++) table[c] = alpha;
+        for (int c = '0'; c <= '9'; c++) table[c] = digit;
+        for (char c : std::string_view {" \t\n\v\f\r"}) table[(uint8_t)c] = space;
+        for (char c : std::string_view {"+-*/=!.<>&|({})],;[:"}) table[(uint8_t)c] = punct;
+        table['\"'] = quote;
+        return table;
+    }();
+
+    static CharClass classify(char c) { return CharClass(char_class[(uint8_t)c]); }
+
+    // keywords are unique by (length, first letter), which gives a perfect hash.
+    constexpr static size_t max_key_word_size = 8;
+    constexpr static auto key_word_table = []() {
+        std::array<int8_t, max_key_word_size * 26> table {};
+        table.fill(-1);
+        for (size_t i = 0; i < std::size(Token::key_words); i++) {
+            auto key_word = Token::key_words[i];
+            table[key_word.size() * 26 + (key_word[0] - 'a')] = i;
+        }
+        return table;
+    }();
+
+    static std::optional<std::string_view> find_key_word(std::string_view word) {
+        if (word.size() >= max_key_word_size || word[0] < 'a' || word[0] > 'z') {
             return std::nullopt;
+        }
+        auto idx = key_word_table[word.size() * 26 + (word[0] - 'a')];
+        if (idx < 0 || Token::key_words[idx] != word) {
+            return std::nullopt;
+        }
+        return Token::key_words[idx];
+    }
+
+    // match the operator or bracket starting at text[pos], preferring the longest operator.
+    static std::optional<Token> match_punct(std::string_view text, size_t pos) {
+        // at the last byte this reads the '\0' sentinel
+        auto next = text.data()[pos + 1];
+        auto op = [&](OpKind kind) {
+            const auto& token = op_tokens[size_t(kind)];
+            return Token(kind, text.substr(pos, token.str().size()), token.type());
+        };
+        auto bracket = [&](std::string_view s) {
+            return Token(text.substr(pos, s.size()), Token::Type::bracket);
         };
+        switch (text[pos]) {
+        case '+':
+            return op(OpKind::Add);
+        case '-':
+            return op(OpKind::Sub);
+        case '*':
+            return op(OpKind::Mul);
+        case '/':
+            return op(OpKind::Div);
+        case '.':
+            return op(OpKind::Member);
+        case '=':
+            return next == '=' ? op(OpKind::Equal) : op(OpKind::Assign);
+        case '<':
+            return next == '=' ? op(OpKind::LessOrEqual) : op(OpKind::Less);
+        case '>':
+            return next == '=' ? op(OpKind::GreaterOrEqual) : op(OpKind::Greater);
+        case '&':
+            return next == '&' ? op(OpKind::And) : op(OpKind::Ref);
+        case '!':
+            if (next == '=') return op(OpKind::NotEqual);
+            break;
+        case '|':
+            if (next == '|') return op(OpKind::Or);
+            break;
+        case '(':
+            return bracket("(");
+        case '{':
+            return bracket("{");
+        case '}':
+            return bracket("}");
+        case ')':
+            return bracket(")");
+        case ',':
+            return bracket(",");
+        case ';':
+            return bracket(";");
+        case '[':
+            return op(OpKind::Subscript);
+        case ']':
+            return bracket("]");
+        case ':':
+            return bracket(":");
+        default:
+            break;
+        }
+        return std::nullopt;
+    }
 
-        auto is_bracket_word = [&]() -> std::optional<std::string> {
-            for (auto& bracket : Token::brackets) {
-                if (text.substr(pos, bracket.size()) == bracket) {
-                    pos += bracket.size();
-                    return std::string(bracket);
-                }
+    static TokenStream get_token_stream(std::string_view text) { return TokenStream(text); }
+
+    // position just past the '}' closing the block that starts at pos, npos when the text
+    // ends first. string constants are stepped over, braces inside them do not count.
+    static size_t skip_block(std::string_view text, size_t pos) {
+        for (int depth = 1; pos < text.size(); pos++) {
+            switch (text[pos]) {
+            case '{':
+                depth++;
+                break;
+            case '}':
+                if (--depth == 0) return pos + 1;
+                break;
+            case '\"':
+                pos = text.find('\"', pos + 1);
+                if (pos == std::string_view::npos) return pos;
+                break;
+            default:
+                break;
             }
-            return std::nullopt;
+        }
+        return std::string_view::npos;
+    }
+
+    // appends tokens starting at text[pos] until max_tokens are buffered or the text ends,
+    // returns where to continue. text must be followed by a '\0' byte: no character class
+    // matches it, so scans stop there without bounds checks and the main loop only compares
+    // the position when it meets a '\0'.
+    static size_t tokenize(std::string_view text, size_t pos, std::vector<Token>& tokens,
+                           size_t max_tokens) {
+        const char* data = text.data();
+        auto scan = [&](auto&& pred) {
+            while (pred(classify(data[pos]), data[pos])) pos++;
         };
-        while (pos < text.size()) {
-            if (std::isspace(text[pos])) {
-                pos++;
-            } else if (auto key_word = is_key_words()) {
-                tokens.push_back(Token(*key_word, Token::Type::key_word));
-            } else if (auto op = is_op_words()) {
-                tokens.push_back(Token(*op, Token::Type::op));
-            } else if (auto bracket = is_bracket_word()) {
-                tokens.push_back(Token(*bracket, Token::Type::bracket));
-            } else {
-                if (std::isalpha(text[pos])) {
-                    // variable
-                    std::string variable;
-                    while (isvariable(text[pos])) {
-                        variable.push_back(text[pos++]);
-                    }
-                    tokens.push_back(Token {variable, Token::Type::variable});
+        while (tokens.size() < max_tokens) {
+            const auto begin = pos;
+            switch (classify(data[pos])) {
+            case space:
+                scan([](CharClass cc, char) { return cc == space; });
+                break;
+            case alpha: {
+                scan([](CharClass cc, char) { return cc == alpha || cc == digit; });
+                auto word = text.substr(begin, pos - begin);
+                if (find_key_word(word)) {
+                    tokens.push_back(Token(word, Token::Type::key_word));
+                } else if (word.starts_with("arr") || word.starts_with("let")) {
+                    // arr and let are prefix operators and bind even without a following space
+                    pos = begin + 3;
+                    tokens.push_back(Token(word[0] == 'a' ? OpKind::Arr : OpKind::Let,
+                                           word.substr(0, 3), Token::Type::op));
                 } else {
-                    // constants
-                    if (text[pos] == '\"') {
-                        // string
-                        std::string str = "\"";
-                        pos++;
-                        while (text[pos] != '\"') {
-                            str.push_back(text[pos++]);
-                        }
-                        pos++;
-                        tokens.push_back(Token {str, Token::Type::constant});
+                    tokens.push_back(Token(word, Token::Type::variable, intern(word)));
+                }
+                break;
+            }
+            case digit: {
+                // classified in the same pass: an integer is digits only, a decimal adds one '.'
+                // and one exponent, with a '-' only right after the 'e'
+                auto literal = Token::Literal::integer;
+                bool dot = false, exponent = false;
+                for (;; pos++) {
+                    char c = data[pos];
+                    auto cc = classify(c);
+                    if (cc != alpha && cc != digit && c != '.' && c != '-') break;
+                    bool sign = c == '-' && (data[pos - 1] == 'e' || data[pos - 1] == 'E');
+                    if (cc == digit || sign) continue;
+                    if (c == '.' && !dot && !exponent) {
+                        dot = true;
+                    } else if ((c == 'e' || c == 'E') && !exponent) {
+                        exponent = true;
                     } else {
-                        std::string constant;
-                        while (std::isalpha(text[pos]) || std::isdigit(text[pos]) ||
-                               text[pos] == '.' || text[pos] == '-') {
-                            constant.push_back(text[pos++]);
-                        }
-                        tokens.push_back(Token {constant, Token::Type::constant});
+                        literal = Token::Literal::malformed;
                     }
+                    if (literal == Token::Literal::integer) literal = Token::Literal::decimal;
                 }
+                tokens.push_back(Token(text.substr(begin, pos - begin), literal));
+                break;
+            }
+            case quote: {
+                // the token keeps the leading quote so the parser can tell it is a string
+                auto* close = static_cast<const char*>(
+                        std::memchr(data + pos + 1, '\"', text.size() - pos - 1));
+                if (close == nullptr) parse_error(text, begin, "unterminated string constant");
+                pos = close - data;
+                tokens.push_back(Token(text.substr(begin, pos - begin), Token::Literal::string));
+                pos++;
+                break;
+            }
+            case punct: {
+                auto token = match_punct(text, pos);
+                if (!token) parse_error(text, pos, "unexpected character " + std::string(1, data[pos]));
+                pos += token->str().size();
+                tokens.push_back(*token);
+                break;
+            }
+            default:
+                if (data[pos] == '\0' && pos == text.size()) return pos;
+                parse_error(text, pos, "unexpected character " + std::string(1, data[pos]));
             }
         }
-        return tokens;
+        return pos;
+    }
+};
+
+inline size_t TokenStream::skip_block() {
+    auto begin = _cur_pos < _tokens.size() ? offset(_tokens[_cur_pos]) : _scan_pos;
+    auto end = Tokenizer::skip_block(_source, begin);
+    if (end == std::string_view::npos) error_at_end("unexpected end of file");
+    _tokens.clear();
+    _cur_pos = 0;
+    _scan_pos = end;
+    // usually only the next function header is read before the next skip
+    _chunk = 16;
+    return begin;
+}
+
+inline bool TokenStream::refill() {
+    _tokens.clear();
+    _cur_pos = 0;
+    if (_scan_pos < _source.size()) {
+        _scan_pos = Tokenizer::tokenize(_source, _scan_pos, _tokens, _chunk);
+        _chunk = std::min(_chunk * 2, chunk_tokens);
     }
-};
\ No newline at end of file
+    return !_tokens.empty();
+}
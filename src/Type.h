@@ -1,4 +1,5 @@
 #pragma once
+#include <cstdint>
 #include <map>
 #include <string>
 #include <type_traits>
@@ -6,7 +7,8 @@
 #include <vector>
 
 #include "util.h"
-enum class Type { Int = 0, Bool, Float, String, Ref, Arr, Struct };
+// Int, Bool and Float are held inline by a Value, the rest on the heap
+enum class Type : uint8_t { Int = 0, Bool, Float, String, Ref, Arr, Struct, Map };
 
 inline std::string type_to_str(Type type) {
     switch (type) {
@@ -24,18 +26,9 @@ inline std::string type_to_str(Type type) {
         return "Arr";
     case Type::Struct:
         return "Struct";
+    case Type::Map:
+        return "Map";
     default:
         return "Non";
     }
 }
-
-template <typename T>
-constexpr auto is_basic_type_v = false;
-using CppTypeSumType = std::variant<int64_t, double, std::string, bool>;
-template <typename Derived, Type _type>
-struct Typeinfo {
-    constexpr static auto _is_ref = _type == Type::Ref;
-    constexpr static auto _is_basic = is_basic_type_v<Derived>;
-    constexpr Type type() const { return _type; }
-    constexpr auto is_ref() { return _type == Type::Ref; }
-};
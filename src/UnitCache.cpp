@@ -0,0 +1,423 @@
+#include "UnitCache.h"
+
+#include <unistd.h>
+
+#include <cstring>
+#include <fstream>
+
+#include "Ast.h"
+#include "CompileUnit.h"
+#include "ExprBuild.h"
+#include "SourceFile.h"
+
+namespace {
+constexpr std::string_view magic = "YCCC";
+
+void put_fixed(std::string& out, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) out.push_back(char(v >> (i * 8)));
+}
+
+uint64_t get_fixed(std::string_view data, size_t pos, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) v |= uint64_t(uint8_t(data[pos + i])) << (i * 8);
+    return v;
+}
+} // namespace
+
+void UnitWriter::put_varint(std::string& out, uint64_t v) {
+    while (v >= 0x80) {
+        out.push_back(char(v | 0x80));
+        v >>= 7;
+    }
+    out.push_back(char(v));
+}
+
+void UnitWriter::varint(uint64_t v) {
+    put_varint(_body, v);
+}
+
+void UnitWriter::symbol(SymbolId id) {
+    auto [it, inserted] = _local_ids.emplace(id, _symbols.size());
+    if (inserted) _symbols.push_back(id);
+    varint(it->second);
+}
+
+void UnitWriter::value(const Value& v) {
+    u8(uint8_t(v.type()));
+    switch (v.type()) {
+    case Type::Int: {
+        // zigzag keeps small negative numbers short
+        auto i = v.as_int();
+        varint((uint64_t(i) << 1) ^ uint64_t(i >> 63));
+        break;
+    }
+    case Type::Bool:
+        u8(v.as_bool());
+        break;
+    case Type::Float: {
+        auto f = v.as_float();
+        uint64_t bits;
+        std::memcpy(&bits, &f, sizeof(bits));
+        put_fixed(_body, bits, 8);
+        break;
+    }
+    case Type::String: {
+        auto& s = v.as_string();
+        varint(s.size());
+        _body += s;
+        break;
+    }
+    default:
+        fail();
+    }
+}
+
+void UnitWriter::expr(ExprNode* node) {
+    node->serialize(*this);
+}
+
+void UnitWriter::op(OpKind kind, std::span<ExprNode* const> children) {
+    if (children.size() != size_t(Token::op_info(kind).arity)) return fail();
+    u8(uint8_t(kind));
+    for (auto* child : children) expr(child);
+}
+
+void UnitWriter::call(SymbolId name, std::span<ExprNode* const> args) {
+    u8(call_tag);
+    symbol(name);
+    varint(args.size());
+    for (auto* arg : args) expr(arg);
+}
+
+void UnitWriter::ast(AstNode* node) {
+    node->serialize(*this);
+}
+
+std::string UnitWriter::finish(uint64_t source_hash) {
+    std::string payload;
+    put_varint(payload, _symbols.size());
+    for (auto id : _symbols) {
+        const auto& name = symbol_name(id);
+        put_varint(payload, name.size());
+        payload += name;
+    }
+    payload += _body;
+
+    std::string out {magic};
+    put_fixed(out, UnitCache::format_version, 4);
+    put_fixed(out, source_hash, 8);
+    put_fixed(out, UnitCache::content_hash(payload), 8);
+    return out + payload;
+}
+
+bool UnitReader::read_header(uint64_t source_hash) {
+    // magic, format version, source hash, payload hash
+    constexpr size_t header_size = 24;
+    if (_data.size() < header_size || !_data.starts_with(magic) ||
+        get_fixed(_data, 4, 4) != UnitCache::format_version ||
+        get_fixed(_data, 8, 8) != source_hash ||
+        get_fixed(_data, 16, 8) != UnitCache::content_hash(_data.substr(header_size))) {
+        return false;
+    }
+    _pos = header_size;
+    auto symbol_count = count();
+    _symbols.reserve(symbol_count);
+    for (size_t i = 0; i < symbol_count && !_failed; i++) {
+        auto size = count();
+        if (_failed) break;
+        _symbols.push_back(intern(_data.substr(_pos, size)));
+        _pos += size;
+    }
+    return !_failed;
+}
+
+uint8_t UnitReader::u8() {
+    if (_pos >= _data.size()) {
+        _failed = true;
+        return 0;
+    }
+    return _data[_pos++];
+}
+
+uint64_t UnitReader::varint() {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64 && !_failed; shift += 7) {
+        auto byte = u8();
+        v |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return v;
+    }
+    _failed = true;
+    return 0;
+}
+
+size_t UnitReader::count() {
+    auto n = varint();
+    if (n > _data.size() - std::min(_pos, _data.size())) {
+        _failed = true;
+        return 0;
+    }
+    return n;
+}
+
+SymbolId UnitReader::symbol() {
+    auto id = varint();
+    if (id >= _symbols.size()) {
+        _failed = true;
+        return intern("");
+    }
+    return _symbols[id];
+}
+
+Value UnitReader::value() {
+    switch (Type(u8())) {
+    case Type::Int: {
+        auto v = varint();
+        return Value {int64_t(v >> 1) ^ -int64_t(v & 1)};
+    }
+    case Type::Bool:
+        return Value {u8() != 0};
+    case Type::Float: {
+        if (_data.size() - std::min(_pos, _data.size()) < 8) break;
+        auto bits = get_fixed(_data, _pos, 8);
+        _pos += 8;
+        double f;
+        std::memcpy(&f, &bits, sizeof(f));
+        return Value {f};
+    }
+    case Type::String: {
+        auto size = count();
+        if (_failed) break;
+        auto s = _data.substr(_pos, size);
+        _pos += size;
+        return Value::make_Interned(s);
+    }
+    default:
+        break;
+    }
+    _failed = true;
+    return Value::default_value;
+}
+
+ExprNode* UnitReader::expr() {
+    if (_failed) return _arena->create<ConstantValueNode>(Value::default_value);
+    auto tag = u8();
+    if (tag < Token::op_kind_count) {
+        auto kind = OpKind(tag);
+        if (!ExprBuild::has_op_node(kind)) {
+            _failed = true;
+            return expr();
+        }
+        auto* lhs = expr();
+        auto* rhs = Token::op_info(kind).arity == 2 ? expr() : nullptr;
+        return ExprBuild::build_op(_arena, kind, lhs, rhs);
+    }
+    switch (tag) {
+    case UnitWriter::constant_tag:
+        return _arena->create<ConstantValueNode>(value());
+    case UnitWriter::variable_tag:
+        return _arena->create<VariableNode>(symbol());
+    case UnitWriter::typed_arr_tag: {
+        auto kind = u8();
+        ArrOperator* arr;
+        if (kind == uint8_t(Array::Kind::Columns)) {
+            arr = _arena->create<ArrOperator>(symbol());
+        } else if (kind <= uint8_t(Array::Kind::Float)) {
+            arr = _arena->create<ArrOperator>(Array::Kind(kind));
+        } else {
+            _failed = true;
+            return expr();
+        }
+        arr->set_children(_arena, {{expr()}});
+        return arr;
+    }
+    case UnitWriter::slice_tag: {
+        bool has_hi = u8();
+        auto* slice = _arena->create<SliceOperator>(has_hi);
+        std::vector<ExprNode*> children(has_hi ? 3 : 2);
+        for (auto& child : children) child = expr();
+        slice->set_children(_arena, children);
+        return slice;
+    }
+    case UnitWriter::call_tag: {
+        auto name = symbol();
+        std::vector<ExprNode*> args(count());
+        for (auto& arg : args) arg = expr();
+        auto* func_call =
+                _arena->create<FuncCallOperator>(FunctionSignature {name, int(args.size())});
+        func_call->set_children(_arena, args);
+        return func_call;
+    }
+    default:
+        _failed = true;
+        return expr();
+    }
+}
+
+StmtNode* UnitReader::stmt() {
+    if (!_failed && u8() == UnitWriter::stmt_tag) {
+        std::vector<AstNode*> commands(count());
+        for (auto& command : commands) command = ast();
+        auto* stmt_node = _arena->create<StmtNode>();
+        stmt_node->set_commands(_arena, commands);
+        return stmt_node;
+    }
+    _failed = true;
+    return _arena->create<StmtNode>();
+}
+
+AstNode* UnitReader::ast() {
+    if (_failed || _pos >= _data.size()) {
+        _failed = true;
+        return _arena->create<StmtNode>();
+    }
+    // statement blocks are read by stmt() including their tag
+    switch (_data[_pos]) {
+    case UnitWriter::stmt_tag:
+        return stmt();
+    case UnitWriter::expr_stmt_tag: {
+        _pos++;
+        Expr expr_value {expr()};
+        return _arena->create<ExprExecuteNode>(expr_value);
+    }
+    case UnitWriter::return_tag: {
+        _pos++;
+        Expr ret_expr {expr()};
+        return _arena->create<ReturnNode>(ret_expr);
+    }
+    case UnitWriter::if_tag: {
+        _pos++;
+        Expr cond {expr()};
+        auto* if_node = _arena->create<IfNode>(cond, stmt());
+        if (u8()) if_node->set_else(stmt());
+        return if_node;
+    }
+    case UnitWriter::while_tag: {
+        _pos++;
+        Expr cond {expr()};
+        return _arena->create<WhileNode>(cond, stmt());
+    }
+    case UnitWriter::for_tag: {
+        _pos++;
+        Expr init {expr()};
+        Expr cond {expr()};
+        Expr step {expr()};
+        return _arena->create<ForNode>(init, cond, step, stmt());
+    }
+    case UnitWriter::foreach_tag: {
+        _pos++;
+        Expr arr {expr()};
+        auto name = symbol();
+        return _arena->create<ForeachNode>(arr, name, stmt());
+    }
+    default:
+        _failed = true;
+        return _arena->create<StmtNode>();
+    }
+}
+
+namespace UnitCache {
+
+uint64_t content_hash(std::string_view text) {
+    // fnv-1a over 8 byte words, seeded with the length
+    constexpr uint64_t prime = 0x100000001b3;
+    uint64_t hash = 0xcbf29ce484222325 ^ text.size();
+    size_t i = 0;
+    for (; i + 8 <= text.size(); i += 8) {
+        uint64_t word;
+        std::memcpy(&word, text.data() + i, sizeof(word));
+        hash = (hash ^ word) * prime;
+        hash ^= hash >> 29;
+    }
+    for (; i < text.size(); i++) {
+        hash = (hash ^ uint8_t(text[i])) * prime;
+    }
+    return hash;
+}
+
+std::filesystem::path cache_path(const std::filesystem::path& source) {
+    return source.parent_path() / ".ycc_cache" / (source.filename().string() + ".bin");
+}
+
+bool load(const std::filesystem::path& cache_file, uint64_t source_hash, CompileUnit& unit) {
+    SourceFile data(cache_file);
+    if (!data.is_open()) return false;
+    // nodes go to a scratch arena first, so a broken entry leaves the unit untouched
+    Arena arena;
+    UnitReader in(data.text(), &arena);
+    if (!in.read_header(source_hash)) return false;
+
+    std::vector<CompileUnit::FuncDecl> funcs(in.count());
+    for (auto& func : funcs) {
+        func.name = in.symbol();
+        func.args_name.resize(in.count());
+        for (auto& arg : func.args_name) arg = in.symbol();
+        func.node = arena.create<FuncNode>(symbol_name(func.name));
+        func.node->set_stmt(in.stmt());
+    }
+    std::vector<CompileUnit::StructDecl> structs(in.count());
+    for (auto& decl : structs) {
+        decl.name = in.symbol();
+        if (in.u8()) decl.base = in.symbol();
+        decl.members.resize(in.count());
+        for (auto& member : decl.members) {
+            member.name = in.symbol();
+            if (in.u8()) {
+                member.struct_name = in.symbol();
+            } else {
+                member.value = in.value();
+            }
+        }
+    }
+    // bytes after the last struct mean the entry is not what store() wrote
+    if (in.failed() || !in.at_end()) return false;
+
+    unit.arena()->acquire_data(&arena);
+    for (auto& func : funcs) unit.add_func(func.name, std::move(func.args_name), func.node);
+    for (auto& decl : structs) unit.add_struct(std::move(decl));
+    return true;
+}
+
+void store(const std::filesystem::path& cache_file, uint64_t source_hash, const CompileUnit& unit) {
+    UnitWriter out;
+    out.varint(unit.funcs().size());
+    for (const auto& func : unit.funcs()) {
+        out.symbol(func.name);
+        out.varint(func.args_name.size());
+        for (auto arg : func.args_name) out.symbol(arg);
+        out.ast(func.node);
+    }
+    out.varint(unit.structs().size());
+    for (const auto& decl : unit.structs()) {
+        out.symbol(decl.name);
+        out.u8(decl.base != SymbolTable::invalid_id);
+        if (decl.base != SymbolTable::invalid_id) out.symbol(decl.base);
+        out.varint(decl.members.size());
+        for (const auto& member : decl.members) {
+            out.symbol(member.name);
+            out.u8(member.struct_name != SymbolTable::invalid_id);
+            if (member.struct_name != SymbolTable::invalid_id) {
+                out.symbol(member.struct_name);
+            } else {
+                out.value(member.value);
+            }
+        }
+    }
+    if (!out.ok()) return;
+    auto bytes = out.finish(source_hash);
+
+    std::error_code ec;
+    std::filesystem::create_directories(cache_file.parent_path(), ec);
+    if (ec) return;
+    // write aside and rename, so a concurrent run never maps a half written entry
+    auto tmp = cache_file;
+    tmp += ".tmp" + std::to_string(::getpid());
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(bytes.data(), bytes.size());
+        if (!file) ec = std::make_error_code(std::errc::io_error);
+    }
+    if (!ec) std::filesystem::rename(tmp, cache_file, ec);
+    if (ec) std::filesystem::remove(tmp, ec);
+}
+
+} // namespace UnitCache
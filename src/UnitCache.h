@@ -0,0 +1,113 @@
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "Symbol.h"
+#include "Token.h"
+#include "Value.h"
+
+class Arena;
+struct AstNode;
+struct CompileUnit;
+struct ExprNode;
+struct StmtNode;
+
+// compact binary form of a parsed and folded compile unit. symbols are written as indexes
+// into a per-unit name table, integers as varints. nodes write themselves through
+// serialize(), UnitReader rebuilds them directly in an arena.
+struct UnitWriter {
+    enum Tag : uint8_t {
+        // expression tags below op_kind_count are operators, written as their OpKind
+        constant_tag = Token::op_kind_count,
+        variable_tag,
+        call_tag,
+        // statements
+        expr_stmt_tag,
+        return_tag,
+        stmt_tag,
+        if_tag,
+        while_tag,
+        for_tag,
+        foreach_tag,
+        // arr int|float|bool N: the element kind, then N. arr B N: Columns, the struct, N
+        typed_arr_tag,
+        // a[lo:hi]: whether hi is there, then a, lo and hi
+        slice_tag,
+    };
+
+    void u8(uint8_t v) { _body.push_back(char(v)); }
+    void varint(uint64_t v);
+    void symbol(SymbolId id);
+    void value(const Value& v);
+
+    void expr(ExprNode* node);
+    void op(OpKind kind, std::span<ExprNode* const> children);
+    void call(SymbolId name, std::span<ExprNode* const> args);
+    void ast(AstNode* node);
+
+    // false when the unit holds something that has no binary form
+    bool ok() const { return _ok; }
+    void fail() { _ok = false; }
+
+    std::string finish(uint64_t source_hash);
+
+private:
+    static void put_varint(std::string& out, uint64_t v);
+
+    std::string _body;
+    std::vector<SymbolId> _symbols;
+    std::unordered_map<SymbolId, uint32_t> _local_ids;
+    bool _ok = true;
+};
+
+struct UnitReader {
+    UnitReader(std::string_view data, Arena* arena) : _data(data), _arena(arena) {}
+
+    bool read_header(uint64_t source_hash);
+    uint8_t u8();
+    uint64_t varint();
+    SymbolId symbol();
+    Value value();
+    // an element count, at least one byte must remain for each element
+    size_t count();
+
+    ExprNode* expr();
+    AstNode* ast();
+    StmtNode* stmt();
+
+    // set once the data turned out truncated or malformed, results are garbage from then on
+    bool failed() const { return _failed; }
+    // every byte has been read
+    bool at_end() const { return _pos == _data.size(); }
+
+private:
+    std::string_view _data;
+    size_t _pos = 0;
+    Arena* _arena;
+    std::vector<SymbolId> _symbols;
+    bool _failed = false;
+};
+
+// the cache lives next to the sources: dir/.ycc_cache/name.ycc.bin. an entry is used only
+// when its format version and the content hash of the source still match, the hash of the
+// rest of the entry in its header matches too, and decoding reads it to the last byte.
+namespace UnitCache {
+// bumped when the encoding changes, or what folding produces (folded strings hold formatted
+// numbers)
+constexpr uint32_t format_version = 4;
+
+uint64_t content_hash(std::string_view text);
+
+std::filesystem::path cache_path(const std::filesystem::path& source);
+
+// fills an empty unit from the cache entry, false when it is missing, stale or unreadable
+bool load(const std::filesystem::path& cache_file, uint64_t source_hash, CompileUnit& unit);
+
+// best effort: units that can not be encoded or a read-only directory are skipped
+void store(const std::filesystem::path& cache_file, uint64_t source_hash, const CompileUnit& unit);
+} // namespace UnitCache
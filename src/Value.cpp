@@ -1,108 +1,555 @@
 #include "Value.h"
 
+#include <algorithm>
+#include <shared_mutex>
+#include <type_traits>
+#include <unordered_map>
+
 #include "Context.h"
+#include "Map.h"
 #include "Variable.h"
 namespace ValueOp {
 
-template <typename T>
-    requires(!std::is_same_v<std::remove_cvref_t<T>, std::string>)
-std::string operator+(const std::string l, T&& r) {
-    return l + std::to_string(r);
+namespace {
+// a string repeated count times, a negative count gives ""
+std::string repeat(const std::string& s, const Value& count) {
+    CHECK(count.is_number(), "should not reach here.");
+    std::size_t num;
+    if (count.type() == Type::Float) {
+        num = count.as_float() < 0 ? 0 : std::size_t(count.as_float());
+    } else {
+        num = count.to_int() < 0 ? 0 : count.to_int();
+    }
+    std::string ret;
+    ret.reserve(s.size() * num);
+    while (num--) {
+        ret += s;
+    }
+    return ret;
 }
 
-template <typename T>
-    requires(!std::is_same_v<std::remove_cvref_t<T>, std::string>)
-std::string operator+(T&& l, const std::string r) {
-    return std::to_string(l) + r;
+// operands of arithmetic, after following refs. arrays and structs have no arithmetic.
+void check_numbers(const Value& l, const Value& r) {
+    CHECK(l.is_number() && r.is_number(), "should not reach here.");
 }
 
-template <typename T>
-    requires(!std::is_same_v<std::remove_cvref_t<T>, std::string>)
-bool operator<(const std::string l, T&& r) {
-    return l < std::to_string(r);
+// ints and bools mix like C++ integers, anything with a float is a float
+bool any_float(const Value& l, const Value& r) {
+    return l.type() == Type::Float || r.type() == Type::Float;
 }
+} // namespace
 
-template <typename T>
-    requires(!std::is_same_v<std::remove_cvref_t<T>, std::string>)
-bool operator<(T&& l, const std::string r) {
-    return std::to_string(l) < r;
+bool _less(const Value& L, const Value& R) {
+    if (L.type() != R.type()) {
+        return L.type() < R.type();
+    }
+    // two refs may point at different kinds of values
+    auto& l = L.deref();
+    auto& r = R.deref();
+    if (l.is_str() || r.is_str()) {
+        CHECK(l.is_str() || l.is_number(), "should not reach here.");
+        CHECK(r.is_str() || r.is_number(), "should not reach here.");
+        if (l.is_str() && r.is_str()) return l.as_string() < r.as_string();
+        // a number compares as its text
+        return l.to_string() < r.to_string();
+    }
+    check_numbers(l, r);
+    if (any_float(l, r)) return l.to_float() < r.to_float();
+    return l.to_int() < r.to_int();
 }
 
-template <typename T>
-    requires(!std::is_same_v<std::remove_cvref_t<T>, std::string>)
-std::string operator*(T&& l, const std::string r) {
-    std::size_t num = l < 0 ? 0 : l;
-    std::string ret;
-    while (num--) {
-        ret += r;
+// same result as !_less(L, R) && !_less(R, L)
+bool _equal(const Value& L, const Value& R) {
+    if (L.type() != R.type()) return false;
+    auto& l = L.deref();
+    auto& r = R.deref();
+    if (l.is_str() && r.is_str()) {
+        if (l.is_interned() && r.is_interned()) return &l.as_string() == &r.as_string();
+        return l.as_string() == r.as_string();
     }
-    return ret;
+    return !_less(L, R) && !_less(R, L);
 }
 
-template <typename T>
-    requires(!std::is_same_v<std::remove_cvref_t<T>, std::string>)
-std::string operator*(const std::string l, T&& r) {
-    std::size_t num = r < 0 ? 0 : r;
-    std::string ret;
-    while (num--) {
-        ret += l;
+Value Add(const Value& L, const Value& R) {
+    auto& l = L.deref();
+    auto& r = R.deref();
+    if (l.is_str() || r.is_str()) {
+        CHECK(l.is_str() || l.is_number(), "should not reach here.");
+        CHECK(r.is_str() || r.is_number(), "should not reach here.");
+        std::string out;
+        l.append_to(out);
+        r.append_to(out);
+        return out;
     }
-    return ret;
+    check_numbers(l, r);
+    if (any_float(l, r)) return l.to_float() + r.to_float();
+    return l.to_int() + r.to_int();
 }
 
-bool _less(const Value& L, const Value& R) {
-    if (L.type() != R.type()) {
-        return L.type() < R.type();
+Value Sub(const Value& L, const Value& R) {
+    auto& l = L.deref();
+    auto& r = R.deref();
+    // a string minus a string or a number is the default value, anything else must be numbers
+    bool scalars = (l.is_str() || l.is_number()) && (r.is_str() || r.is_number());
+    if (scalars && (l.is_str() || r.is_str())) return Value::default_value;
+    check_numbers(l, r);
+    if (any_float(l, r)) return l.to_float() - r.to_float();
+    return l.to_int() - r.to_int();
+}
+
+Value Mul(const Value& L, const Value& R) {
+    auto& l = L.deref();
+    auto& r = R.deref();
+    if (l.is_str() && r.is_str()) return Value::default_value;
+    if (l.is_str()) return repeat(l.as_string(), r);
+    if (r.is_str()) return repeat(r.as_string(), l);
+    check_numbers(l, r);
+    if (any_float(l, r)) return l.to_float() * r.to_float();
+    return l.to_int() * r.to_int();
+}
+
+} // namespace ValueOp
+
+void Value::append_to(std::string& out) const {
+    auto& v = deref();
+    switch (v._type) {
+    case Type::Int:
+        Number::append(out, v._int);
+        break;
+    case Type::Bool:
+        Number::append(out, v.as_bool());
+        break;
+    case Type::Float:
+        Number::append(out, v._float);
+        break;
+    case Type::String:
+        out += v.as_string();
+        break;
+    default:
+        CHECK(0, "should not reach here.");
     }
-    return std::visit([](auto&& l, auto&& r) { return l < r; }, L.getSumType(), R.getSumType());
 }
 
-Value Add(const Value& L, const Value& R) {
-    return std::visit([](auto&& l, auto&& r) { return Value {l + r}; }, L.getSumType(),
-                      R.getSumType());
+namespace {
+// interned strings are never freed, the keys view their text. literals are interned while
+// files are parsed on several threads, hence the lock.
+struct StringPool {
+    std::shared_mutex mutex;
+    std::unordered_map<std::string_view, Shared<std::string>*> strings;
+};
+} // namespace
+
+Value Value::make_Interned(std::string_view text) {
+    static StringPool pool;
+    Value v;
+    v._type = Type::String;
+    {
+        std::shared_lock lock(pool.mutex);
+        if (auto it = pool.strings.find(text); it != pool.strings.end()) {
+            v._str = it->second;
+            return v;
+        }
+    }
+    std::unique_lock lock(pool.mutex);
+    // another thread may have added it between the two locks
+    if (auto it = pool.strings.find(text); it != pool.strings.end()) {
+        v._str = it->second;
+        return v;
+    }
+    v._str = new InternedString(text);
+    v._str->interned = true;
+    pool.strings.emplace(v._str->data, v._str);
+    return v;
 }
 
-Value Sub(const Value& L, const Value& R) {
-    return std::visit(
-            [](auto&& l, auto&& r) -> Value {
-                using ltype = std::decay_t<decltype(l)>;
-                using rtype = std::decay_t<decltype(r)>;
-                if constexpr (std::is_same_v<ltype, std::string> ||
-                              std::is_same_v<rtype, std::string>) {
-                    return Value::default_value;
+Map& Value::write_map() {
+    if (is_ref()) return ref().write_map();
+    CHECK(is_map(), "must be a map, now is " + type_to_str(type()));
+    return unshare(_map);
+}
+
+Value Value::make_Map() {
+    Value v;
+    v._type = Type::Map;
+    v._map = new Shared<Map>(Map());
+    return v;
+}
+
+std::string Value::ref_debug_info() const {
+    if (!is_ref()) return "";
+    return "ref from : " + _ref->data.mgr()->_name;
+}
+
+void Value::free_heap() {
+    Heap::release(_heap, _type);
+}
+
+Array::Array(size_t size, Kind kind) {
+    switch (kind) {
+    case Kind::Int:
+        _data.emplace<Ints>(size);
+        break;
+    case Kind::Bool:
+        _data.emplace<Bools>(size);
+        break;
+    case Kind::Float:
+        _data.emplace<Floats>(size);
+        break;
+    default:
+        _data.emplace<Values>(size);
+        break;
+    }
+}
+
+Array::Array(Values values) {
+    auto type = values.empty() ? Type::Int : values[0].type();
+    bool same = std::all_of(values.begin(), values.end(),
+                            [&](const Value& v) { return v.type() == type; });
+    if (!same || type > Type::Float) {
+        _data = std::move(values);
+        return;
+    }
+    *this = Array(values.size(), Kind(type));
+    for (size_t i = 0; i < values.size(); i++) set(i, values[i]);
+}
+
+Array Array::filled(size_t size, const Value& v) {
+    Array out;
+    switch (v.type()) {
+    case Type::Int:
+        out._data.emplace<Ints>(size, v.as_int());
+        break;
+    case Type::Bool:
+        out._data.emplace<Bools>(size, v.as_bool());
+        break;
+    case Type::Float:
+        out._data.emplace<Floats>(size, v.as_float());
+        break;
+    case Type::Struct: {
+        auto& members = v.get_struct();
+        auto& table = out._data.emplace<Columns>(Columns {members.shape, size, {}});
+        table.columns.reserve(members.size());
+        for (auto& member : members.slots) table.columns.push_back(filled(size, member));
+        break;
+    }
+    default:
+        out._data.emplace<Values>(size, v);
+        break;
+    }
+    return out;
+}
+
+Value Array::row(size_t i) const {
+    auto& table = buffer<Columns>();
+    StructMembers members {table.shape, {}};
+    members.slots.reserve(table.columns.size());
+    for (auto& column : table.columns) members.slots.push_back(column.get(i));
+    return Value::make_Struct(std::move(members));
+}
+
+bool Array::set_row(size_t i, const Value& v) {
+    auto& table = buffer<Columns>();
+    if (v.type() != Type::Struct || v.get_struct().shape != table.shape) return false;
+    auto& members = v.get_struct();
+    for (size_t j = 0; j < table.columns.size(); j++) {
+        // the element is replaced as a whole, a ref in its old member is not written through
+        auto& column = table.columns[j];
+        if (column.kind() == Kind::Boxed) {
+            column.buffer<Values>()[i] = members.slots[j];
+        } else {
+            column.set(i, members.slots[j]);
+        }
+    }
+    return true;
+}
+
+Value& Array::sparse_slot(size_t i) {
+    auto& table = buffer<Sparse>();
+    auto [it, added] = table.index.try_emplace(i, uint32_t(table.boxed.size()));
+    if (!added) return table.boxed[it->second].second;
+    table.boxed.emplace_back(i, table.dense->get(i));
+    // past one element in eight the index costs more than boxing every element
+    if (table.boxed.size() > table.size() / 8) {
+        box();
+        return buffer<Values>()[i];
+    }
+    return table.boxed.back().second;
+}
+
+void Array::box() {
+    if (kind() != Kind::Sparse && size() >= sparse_size) {
+        Array dense = std::move(*this);
+        _data.emplace<Sparse>(std::move(dense));
+        return;
+    }
+    Values values;
+    values.reserve(size());
+    for (size_t i = 0; i < size(); i++) values.push_back(get(i));
+    _data = std::move(values);
+}
+
+namespace {
+// v as an element of a buffer that holds it
+template <typename Buffer>
+typename Buffer::value_type element(const Value& v) {
+    if constexpr (std::is_same_v<Buffer, Array::Values>) {
+        return v;
+    } else if constexpr (std::is_same_v<Buffer, Array::Floats>) {
+        return v.as_float();
+    } else {
+        return v.as_int();
+    }
+}
+} // namespace
+
+bool Array::holds(const Value& v) const {
+    switch (kind()) {
+    case Kind::Int:
+    case Kind::Bool:
+    case Kind::Float:
+        return v.type() == Type(kind());
+    case Kind::Columns:
+        return v.type() == Type::Struct && v.get_struct().shape == buffer<Columns>().shape;
+    default:
+        return true;
+    }
+}
+
+Value Array::zero() const {
+    switch (kind()) {
+    case Kind::Int:
+        return 0;
+    case Kind::Bool:
+        return false;
+    case Kind::Float:
+        return 0.0;
+    case Kind::Columns: {
+        auto& table = buffer<Columns>();
+        StructMembers members {table.shape, {}};
+        for (auto& column : table.columns) members.slots.push_back(column.zero());
+        return Value::make_Struct(std::move(members));
+    }
+    case Kind::Sparse:
+        return buffer<Sparse>().dense->zero();
+    case Kind::View:
+        return buffer<View>().items().zero();
+    default:
+        return Value::default_value;
+    }
+}
+
+void Array::insert(size_t i, const Value& v) {
+    if (kind() == Kind::View) materialize();
+    if (!holds(v)) box();
+    std::visit(
+            [&](auto& buffer) {
+                using Buffer = std::decay_t<decltype(buffer)>;
+                if constexpr (std::is_same_v<Buffer, View>) {
+                    // copied out above
+                } else if constexpr (std::is_same_v<Buffer, Columns>) {
+                    auto& row = v.get_struct();
+                    for (size_t j = 0; j < buffer.columns.size(); j++) {
+                        buffer.columns[j].insert(i, row.slots[j]);
+                    }
+                    buffer.rows++;
+                } else if constexpr (std::is_same_v<Buffer, Sparse>) {
+                    sparse_insert(i, v);
                 } else {
-                    return Value {l - r};
+                    buffer.insert(buffer.begin() + i, element<Buffer>(v));
                 }
             },
-            L.getSumType(), R.getSumType());
+            _data);
 }
 
-Value Mul(const Value& L, const Value& R) {
-    return std::visit(
-            [](auto&& l, auto&& r) -> Value {
-                using ltype = std::decay_t<decltype(l)>;
-                using rtype = std::decay_t<decltype(r)>;
-                if constexpr (std::is_same_v<ltype, std::string> &&
-                              std::is_same_v<rtype, std::string>) {
-                    return Value::default_value;
-                    ;
+Value Array::pop() {
+    auto last = get(size() - 1);
+    resize(size() - 1, last);
+    return last;
+}
+
+void Array::resize(size_t n, const Value& v) {
+    if (kind() == Kind::View) materialize();
+    if (n > size() && !holds(v)) box();
+    std::visit(
+            [&](auto& buffer) {
+                using Buffer = std::decay_t<decltype(buffer)>;
+                if constexpr (std::is_same_v<Buffer, View>) {
+                    // copied out above
+                } else if constexpr (std::is_same_v<Buffer, Columns>) {
+                    for (size_t j = 0; j < buffer.columns.size(); j++) {
+                        // v is a struct of the shape when growing, unused when shrinking
+                        auto& column = buffer.columns[j];
+                        column.resize(n, n > buffer.rows ? v.get_struct().slots[j] : v);
+                    }
+                    buffer.rows = n;
+                } else if constexpr (std::is_same_v<Buffer, Sparse>) {
+                    sparse_resize(n, v);
+                } else if (n < buffer.size()) {
+                    buffer.erase(buffer.begin() + n, buffer.end());
                 } else {
-                    return Value {l * r};
+                    // with the value: a zeroed buffer does not zero elements popped before
+                    buffer.resize(n, element<Buffer>(v));
                 }
             },
-            L.getSumType(), R.getSumType());
+            _data);
 }
 
-} // namespace ValueOp
+void Array::reserve(size_t n) {
+    if (kind() == Kind::View) materialize();
+    std::visit(
+            [&](auto& buffer) {
+                using Buffer = std::decay_t<decltype(buffer)>;
+                if constexpr (std::is_same_v<Buffer, View>) {
+                    // copied out above
+                } else if constexpr (std::is_same_v<Buffer, Columns>) {
+                    for (auto& column : buffer.columns) column.reserve(n);
+                } else if constexpr (std::is_same_v<Buffer, Sparse>) {
+                    buffer.dense->reserve(n);
+                } else {
+                    buffer.reserve(n);
+                }
+            },
+            _data);
+}
 
-RefValue::RefValue(ReferenceWrapping ref) : _ref(ref) {}
+void Array::sparse_insert(size_t i, const Value& v) {
+    auto& table = buffer<Sparse>();
+    if (i < table.size()) {
+        for (auto& [key, _] : table.boxed) {
+            if (key >= i) key++;
+        }
+        table.reindex();
+    }
+    bool fits = table.dense->holds(v);
+    table.dense->insert(i, fits ? v : table.dense->zero());
+    if (!fits) sparse_slot(i) = v;
+}
 
-Value & RefValue::Dereference() const {
-    return _ref.Dereference();
+void Array::sparse_resize(size_t n, const Value& v) {
+    auto& table = buffer<Sparse>();
+    auto old = table.size();
+    if (n < old) {
+        if (old - n <= table.boxed.size()) {
+            for (auto i = n; i < old; i++) table.erase(i);
+        } else {
+            std::erase_if(table.boxed, [&](const auto& entry) { return entry.first >= n; });
+            table.reindex();
+        }
+        table.dense->resize(n, v);
+        return;
+    }
+    bool fits = table.dense->holds(v);
+    table.dense->resize(n, fits ? v : table.dense->zero());
+    // slot, not sparse_slot: the array may box completely on the way
+    if (!fits) {
+        for (auto i = old; i < n; i++) slot(i) = v;
+    }
 }
-std::string RefValue::ref_debug_info() const {
-    std::string info = "ref from : " + _ref.mgr()->_name;
-    return info;
+
+void Sparse::erase(size_t i) {
+    auto it = index.find(i);
+    if (it == index.end()) return;
+    auto pos = it->second;
+    index.erase(it);
+    if (pos + 1 != boxed.size()) {
+        boxed[pos] = std::move(boxed.back());
+        index[boxed[pos].first] = pos;
+    }
+    boxed.pop_back();
+}
+
+void Sparse::reindex() {
+    index.clear();
+    for (uint32_t pos = 0; pos < boxed.size(); pos++) index.emplace(boxed[pos].first, pos);
+}
+
+Array Array::view(Shared<Array>* base, size_t lo, size_t hi) {
+    Array out;
+    if (base->data.kind() == Kind::View) {
+        // a slice of a slice looks into the same array
+        auto& inner = base->data.buffer<View>();
+        out._data.emplace<View>(inner.base, inner.offset + lo, hi - lo);
+    } else {
+        out._data.emplace<View>(base, lo, hi - lo);
+    }
+    return out;
+}
+
+void Array::materialize() {
+    // the copy is made before the view, and with it maybe the last hold on base, goes away
+    auto& view = buffer<View>();
+    *this = view.items().copy_range(view.offset, view.length);
+}
+
+Array Array::copy_range(size_t lo, size_t n) const {
+    Array out;
+    std::visit(
+            [&](auto& buffer) {
+                using Buffer = std::decay_t<decltype(buffer)>;
+                if constexpr (std::is_same_v<Buffer, Columns>) {
+                    Columns table {buffer.shape, n, {}};
+                    table.columns.reserve(buffer.columns.size());
+                    for (auto& column : buffer.columns) {
+                        table.columns.push_back(column.copy_range(lo, n));
+                    }
+                    out._data = std::move(table);
+                } else if constexpr (std::is_same_v<Buffer, Sparse> ||
+                                     std::is_same_v<Buffer, View>) {
+                    Values values;
+                    values.reserve(n);
+                    for (size_t i = lo; i < lo + n; i++) values.push_back(get(i));
+                    out = Array(std::move(values));
+                } else {
+                    out._data = Buffer(buffer.begin() + lo, buffer.begin() + lo + n);
+                }
+            },
+            _data);
+    return out;
+}
+
+View::View(Shared<Array>* base, size_t offset, size_t length)
+        : base(base), offset(offset), length(length) {
+    base->refs++;
+}
+
+View::View(const View& other) : View(other.base, other.offset, other.length) {}
+
+View& View::operator=(const View& other) {
+    View copy(other);
+    std::swap(base, copy.base);
+    offset = other.offset;
+    length = other.length;
+    return *this;
+}
+
+View::~View() {
+    if (--base->refs == 0) Heap::release(base, Type::Arr);
+}
+
+Value Value::slice(int64_t lo, int64_t hi) const {
+    auto& v = deref();
+    CHECK(v.is_arr(), "[:] must be used on an arr, now is " + type_to_str(v.type()));
+    auto size = int64_t(v._arr->data.size());
+    CHECK(0 <= lo && lo <= hi && hi <= size, "out of bound in arr now size " +
+                                                     std::to_string(size) + " want " +
+                                                     std::to_string(lo) + ":" +
+                                                     std::to_string(hi));
+    return make_Arr(Array::view(v._arr, lo, hi));
+}
+
+Sparse::Sparse(Array dense) : dense(std::make_unique<Array>(std::move(dense))) {}
+
+Sparse::Sparse(const Sparse& other)
+        : dense(std::make_unique<Array>(*other.dense)), index(other.index), boxed(other.boxed) {}
+
+Sparse& Sparse::operator=(const Sparse& other) {
+    return *this = Sparse(other);
+}
+
+Sparse::~Sparse() = default;
+
+size_t Sparse::size() const {
+    return dense->size();
 }
 
 Value& ReferenceWrapping::Dereference() const {
@@ -110,7 +557,7 @@ Value& ReferenceWrapping::Dereference() const {
 }
 
 std::string ReferenceWrapping::ref_name() const {
-    return _ref->first;
+    return symbol_name(_ref->first);
 }
 
-Value Value::default_value = Value::make_Int(0);
\ No newline at end of file
+Value Value::default_value = 0;
\ No newline at end of file
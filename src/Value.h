@@ -1,4 +1,19 @@
 #pragma once
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <new>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "Heap.h"
+#include "Number.h"
+#include "Shape.h"
+#include "Symbol.h"
 #include "Type.h"
 #include "util.h"
 
@@ -8,47 +23,10 @@ namespace ValueOp {
 bool _less(const Value& L, const Value& R);
 } // namespace ValueOp
 
-template <typename CppType, Type type>
-struct BasicValue : Typeinfo<BasicValue<CppType, type>, type> {
-    BasicValue(const CppType& value) : _value(value) {};
-    CppType _value {};
-    CppTypeSumType getSumType() const { return _value; }
-    CppType CppValue() { return _value; }
-    std::string to_string() const {
-        if constexpr (std::is_same_v<CppType, std::string>) {
-            return _value;
-        } else {
-            return std::to_string(_value);
-        }
-    }
-};
-
-template <typename CppType, Type type>
-constexpr auto is_basic_type_v<BasicValue<CppType, type>> = true;
-
-struct IntValue : public BasicValue<int64_t, Type::Int> {
-    using CppType = int64_t;
-    IntValue(const CppType& rhs) : BasicValue<CppType, Type::Int>(rhs) {}
-};
-
-struct FloatValue : public BasicValue<double, Type::Float> {
-    using CppType = double;
-    FloatValue(const CppType& rhs) : BasicValue<CppType, Type::Float>(rhs) {}
-};
-
-struct StringValue : public BasicValue<std::string, Type::String> {
-    using CppType = std::string;
-    StringValue(const CppType& rhs) : BasicValue<CppType, Type::String>(rhs) {}
-};
-
-struct BoolValue : public BasicValue<bool, Type::Bool> {
-    using CppType = bool;
-    BoolValue(const CppType& rhs) : BasicValue<CppType, Type::Bool>(rhs) {}
-};
-
 struct VariableMgr;
 struct ReferenceWrapping {
-    using VariableRef = std::map<std::string, Value>::iterator;
+    // points at the variable's node in its VariableMgr, which never moves
+    using VariableRef = std::pair<const SymbolId, Value>*;
     ReferenceWrapping() {};
     ReferenceWrapping(VariableRef it, VariableMgr* mgr) : _ref(it), _mgr(mgr) {}
 
@@ -59,223 +37,430 @@ struct ReferenceWrapping {
     std::string ref_name() const;
 
 private:
-    VariableRef _ref;
-    VariableMgr* _mgr;
+    VariableRef _ref = nullptr;
+    VariableMgr* _mgr = nullptr;
 };
 
-struct ReferenceWrapping;
-struct RefValue : public Typeinfo<RefValue, Type::Ref> {
-    RefValue(ReferenceWrapping ref);
-    Value& Dereference() const;
-    ReferenceWrapping _ref;
-    std::string ref_debug_info() const;
+// a struct value: one slot per member of its shape
+struct StructMembers {
+    const Shape* shape = Shape::empty();
+    std::vector<Value> slots;
+
+    size_t size() const { return slots.size(); }
+    SymbolId name(size_t slot) const { return shape->members()[slot]; }
+    // nullptr when the struct has no such member
+    const Value* find(SymbolId name) const;
+    // a missing member is added with the default value
+    Value& operator[](SymbolId name);
 };
 
-struct ArrValue : public Typeinfo<ArrValue, Type::Arr> {
-    ArrValue(const std::vector<Value>& arr) : _arr(arr) {};
-    auto& arr() { return _arr; }
+// memory for number buffers straight from calloc. the memory is zero already, so
+// value-initializing an element does nothing: a large arr N costs neither time nor memory until
+// its pages are written. growing a buffer over elements removed earlier must pass the value.
+template <typename T>
+struct ZeroedAllocator {
+    using value_type = T;
 
-private:
-    std::vector<Value> _arr;
-};
+    ZeroedAllocator() = default;
+    template <typename U>
+    ZeroedAllocator(const ZeroedAllocator<U>&) {}
 
-struct StructValue : public Typeinfo<StructValue, Type::Struct> {
-    StructValue(const std::map<std::string, Value>& map) : _map(map) {}
+    T* allocate(size_t n) {
+        if (auto* p = std::calloc(n, sizeof(T))) return static_cast<T*>(p);
+        throw std::bad_alloc();
+    }
+    void deallocate(T* p, size_t) { std::free(p); }
 
-    auto& map() { return _map; }
+    template <typename U>
+    void construct(U*) {}
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
 
-private:
-    std::map<std::string, Value> _map;
+    template <typename U>
+    bool operator==(const ZeroedAllocator<U>&) const {
+        return true;
+    }
 };
 
-template <typename... Ts>
-constexpr auto is_in_type_set = false;
-
-template <typename U, typename head, typename... Ts>
-constexpr auto is_in_type_set<U, head, Ts...> = std::is_same_v<U, head> || is_in_type_set<U, Ts...>;
+struct Array;
 
-template <typename U, typename T>
-constexpr auto is_in_type_set<U, T> = std::is_same_v<U, T>;
+// an array of structs sharing one shape, stored by member: column j holds member j of every
+// element, so a loop reading x[i].a touches only the a column
+struct Columns {
+    const Shape* shape;
+    size_t rows;
+    std::vector<Array> columns;
+    size_t size() const { return rows; }
+};
 
-template <typename U, typename T>
-constexpr auto is_in_variant = false;
+// a large array that got an element its storage can not hold. instead of boxing every element,
+// such elements live in a hash index over boxed, the rest stay in dense.
+struct Sparse {
+    explicit Sparse(Array dense);
+    Sparse(const Sparse& other);
+    Sparse& operator=(const Sparse& other);
+    Sparse(Sparse&&) = default;
+    Sparse& operator=(Sparse&&) = default;
+    ~Sparse();
+
+    std::unique_ptr<Array> dense;
+    // element index -> position in boxed
+    std::unordered_map<size_t, uint32_t> index;
+    std::vector<std::pair<size_t, Value>> boxed;
+    size_t size() const;
+    // drops the boxed element at i, if any
+    void erase(size_t i);
+    // rebuilds index after the element indices in boxed changed
+    void reindex();
+};
 
-template <typename U, typename... Ts>
-constexpr auto is_in_variant<U, std::variant<Ts...>> = is_in_type_set<U, Ts...>;
+template <typename T>
+struct Shared;
+struct Map;
+
+// a[lo:hi]: length elements of the array in base from offset on. the view keeps base alive and
+// reads from it; a value holding a view copies the elements out before its first write.
+struct View {
+    View(Shared<Array>* base, size_t offset, size_t length);
+    View(const View& other);
+    View& operator=(const View& other);
+    ~View();
+
+    Shared<Array>* base;
+    size_t offset;
+    size_t length;
+    size_t size() const { return length; }
+    const Array& items() const;
+};
 
-struct Value {
-    using autoType = std::variant<IntValue, BoolValue, FloatValue, StringValue, RefValue, ArrValue,
-                                  StructValue>;
+// array storage. while every element has the same number type the elements stay unboxed in
+// one contiguous buffer, storing anything else boxes the whole array into Values once, or into
+// Sparse when the array is large. an array of structs made by arr B N keeps its structs in
+// Columns until an element gets another shape or a reference into an element is taken. a slice
+// is a View into another array until it is written.
+struct Array {
+    // the index of the buffer in _data. Int, Bool and Float match Type.
+    enum class Kind : uint8_t { Int, Bool, Float, Boxed, Columns, Sparse, View };
+    using Ints = std::vector<int64_t, ZeroedAllocator<int64_t>>;
+    using Bools = std::vector<uint8_t, ZeroedAllocator<uint8_t>>;
+    using Floats = std::vector<double, ZeroedAllocator<double>>;
+    using Values = std::vector<Value>;
+
+    // boxing an array at least this large makes it Sparse
+    constexpr static size_t sparse_size = 1 << 16;
+
+    // size elements of the kind's zero value, for Int, Bool, Float and Boxed
+    Array(size_t size, Kind kind);
+    // unboxed when all values have the same number type
+    explicit Array(Values values);
+    // size copies of v: unboxed for a number, stored by column for a struct
+    static Array filled(size_t size, const Value& v);
+
+    Kind kind() const { return Kind(_data.index()); }
+    // the kind of the storage the elements are in, the viewed array's for a View
+    Kind element_kind() const;
+    size_t size() const;
+    Value get(size_t i) const;
+    void set(size_t i, const Value& v);
+    // the element as a Value that can be written through, boxes the array. valid until the
+    // next write to the array.
+    Value& slot(size_t i);
+
+    // growing keeps the storage when it holds v and boxes it otherwise, like set. amortized
+    // constant time at the end.
+    void insert(size_t i, const Value& v);
+    void push(const Value& v) { insert(size(), v); }
+    // the array is not empty
+    Value pop();
+    // new elements are copies of v
+    void resize(size_t n, const Value& v);
+    void reserve(size_t n);
+    // the zero value of the elements: 0, false, 0.0, or a struct of zeros, which the storage
+    // holds without boxing
+    Value zero() const;
+
+    // the column of member name when the array is stored by column, nullptr when it is not or
+    // the shape has no such member. the slot found is kept in cache as for a member access.
+    const Array* column(SymbolId name, MemberCache& cache) const;
+    Array* column(SymbolId name, MemberCache& cache) {
+        return const_cast<Array*>(std::as_const(*this).column(name, cache));
+    }
 
-    static Value default_value;
+    template <typename Buffer>
+    const Buffer& buffer() const {
+        return std::get<Buffer>(_data);
+    }
+    // the elements of an unboxed array or of a View of one, element_kind() tells which buffer
+    template <typename Buffer>
+    std::span<const typename Buffer::value_type> elements() const;
+
+    // elements lo .. hi as a View, without copying them. base holds this array.
+    static Array view(Shared<Array>* base, size_t lo, size_t hi);
+    // a View becomes a copy of its elements. Value::write_array() does this before any write,
+    // the other writing members never see a View.
+    void materialize();
+    template <typename Buffer>
+    Buffer& buffer() {
+        return std::get<Buffer>(_data);
+    }
 
-    Value() : _value(IntValue(0)) {}
-    Value(const Value& rhs) = default;
-    Value& operator=(const Value& rhs) = default;
-    ~Value() = default;
+private:
+    Array() = default;
+    // stores v when the storage can hold it, false otherwise
+    bool try_set(size_t i, const Value& v);
+    // whether v can be stored without boxing
+    bool holds(const Value& v) const;
+    void box();
+    // element i of a Columns array as a struct
+    Value row(size_t i) const;
+    // stores v as element i of a Columns array, false when v is not a struct of its shape
+    bool set_row(size_t i, const Value& v);
+    // element i of a Sparse array, moved to its boxed elements first
+    Value& sparse_slot(size_t i);
+    void sparse_insert(size_t i, const Value& v);
+    void sparse_resize(size_t n, const Value& v);
+
+    // elements lo .. lo + n in storage of their own
+    Array copy_range(size_t lo, size_t n) const;
+
+    std::variant<Ints, Bools, Floats, Values, Columns, Sparse, View> _data;
+};
 
-    bool is_ref() const { return type() == Type::Ref; }
+// strings, refs, arrays, structs and maps live in a reference counted heap object shared by every
+// copy of a value. writes go through unshare(), which copies a shared object first, so each
+// value still behaves as its own copy. the count is not atomic: only the thread running the
+// program copies values that other code can see.
+// interned strings are immutable and live for the whole run: they skip the count entirely, so
+// parser threads can hand them out, and a write copies them like a shared object.
+// an object whose count drops to zero goes to Heap::release.
+struct HeapObject {
+    HeapObject() { Heap::allocated(); }
+    uint32_t refs = 1;
+    bool interned = false;
+};
 
-    bool is_arr() const { return type() == Type::Arr; }
+template <typename T>
+struct Shared : HeapObject {
+    Shared(T value) : data(std::move(value)) {}
+    T data;
+};
 
-    bool is_str() const { return type() == Type::String; }
+// what make_Interned creates: the string and the hash of its text, so a map lookup with a
+// constant key does not hash it again
+struct InternedString : Shared<std::string> {
+    explicit InternedString(std::string_view text)
+            : Shared(std::string(text)), hash(std::hash<std::string_view>()(text)) {}
+    size_t hash;
+};
 
-    bool is_struct() const { return type() == Type::Struct; }
+// 16 bytes: the type tag and either an immediate int, float or bool, or a pointer to a shared
+// heap object.
+struct Value {
+    static Value default_value;
 
-    template <typename T>
-        requires requires(T x) { x.type(); }
-    Value(const T& rhs) : _value(rhs) {}
+    Value() : _int(0) {}
+    Value(const Value& rhs) : _type(rhs._type), _int(rhs._int) {
+        if (rhs.is_heap() && !_heap->interned) _heap->refs++;
+    }
+    Value(Value&& rhs) noexcept : _type(rhs._type), _int(rhs._int) { rhs._type = Type::Int; }
+    Value& operator=(const Value& rhs) {
+        if (this != &rhs) {
+            Value copy(rhs);
+            swap(copy);
+        }
+        return *this;
+    }
+    Value& operator=(Value&& rhs) noexcept {
+        swap(rhs);
+        return *this;
+    }
+    ~Value() {
+        if (is_heap() && !_heap->interned && --_heap->refs == 0) free_heap();
+    }
 
-    Value(ReferenceWrapping rhs) : _value(RefValue {rhs}) {}
+    Value(ReferenceWrapping rhs) : _type(Type::Ref), _ref(new Shared<ReferenceWrapping>(rhs)) {}
 
     template <typename CppType>
         requires(std::is_integral_v<CppType> && !std::is_same_v<CppType, bool>)
-    Value(const CppType& rhs) : _value(IntValue(rhs)) {}
+    Value(const CppType& rhs) : _type(Type::Int), _int(rhs) {}
 
     template <typename CppType>
         requires(std::is_same_v<CppType, bool>)
-    Value(const CppType& rhs) : _value(BoolValue(rhs)) {};
+    Value(const CppType& rhs) : _type(Type::Bool), _int(rhs) {};
 
     template <typename CppType>
         requires(std::is_floating_point_v<CppType>)
-    Value(const CppType& rhs) : _value(FloatValue(rhs)) {}
+    Value(const CppType& rhs) : _type(Type::Float), _float(rhs) {}
 
-    Value(const std::string& rhs) : _value(StringValue(rhs)) {}
+    Value(const std::string& rhs) : _type(Type::String), _str(new Shared<std::string>(rhs)) {}
+    Value(std::string&& rhs)
+            : _type(Type::String), _str(new Shared<std::string>(std::move(rhs))) {}
 
-    Type type() const {
-        return std::visit([](auto&& v) { return v.type(); }, _value);
-    }
+    Type type() const { return _type; }
+
+    bool is_ref() const { return _type == Type::Ref; }
+
+    bool is_arr() const { return _type == Type::Arr; }
+
+    bool is_str() const { return _type == Type::String; }
+
+    bool is_struct() const { return _type == Type::Struct; }
+
+    bool is_map() const { return _type == Type::Map; }
+
+    // int, bool and float, which live in the value itself
+    bool is_number() const { return _type <= Type::Float; }
 
     Value& ref() const {
         CHECK(is_ref(), "use ref must be a ref type now is " + type_to_str(type()));
-        return std::get<RefValue>(_value).Dereference();
+        return _ref->data.Dereference();
     }
 
-    std::string ref_debug_info() const {
-        return std::visit(
-                [](auto&& v) -> std::string {
-                    using T = std::decay_t<decltype(v)>;
-                    if constexpr (std::is_same_v<RefValue, T>) {
-                        return v.ref_debug_info();
-                    } else {
-                        return "";
-                    }
-                },
-                _value);
+    // the value behind any chain of refs
+    const Value& deref() const {
+        const Value* v = this;
+        while (v->is_ref()) v = &v->_ref->data.Dereference();
+        return *v;
     }
+    Value& deref() { return const_cast<Value&>(std::as_const(*this).deref()); }
+
+    std::string ref_debug_info() const;
+
     std::string to_string() const {
-        if (is_ref()) {
-            return ref().to_string();
-        }
-        return std::visit(
-                [](auto&& v) -> std::string {
-                    using T = std::decay_t<decltype(v)>;
-                    if constexpr (T::_is_basic) {
-                        return v.to_string();
-                    }
-                    CHECK(0, "should not reach here.");
-                    return "";
-                },
-                _value);
-    }
-
-    CppTypeSumType getSumType() const {
-        if (is_ref()) {
-            return ref().getSumType();
-        }
-        return std::visit(
-                [](auto&& v) -> CppTypeSumType {
-                    using T = std::decay_t<decltype(v)>;
-                    if constexpr (T::_is_basic) {
-                        return v.getSumType();
-                    }
-                    CHECK(0, "should not reach here.");
-                    return "";
-                },
-                _value);
+        std::string out;
+        append_to(out);
+        return out;
+    }
+    // appends the text form of an int, bool, float or string
+    void append_to(std::string& out) const;
+
+    // unchecked access, the type must match
+    int64_t as_int() const { return _int; }
+    bool as_bool() const { return _int != 0; }
+    double as_float() const { return _float; }
+    const std::string& as_string() const { return _str->data; }
+    // appends the text of v to this string in place, a shared buffer is copied first
+    void append_string(const Value& v) { v.append_to(unshare(_str)); }
+
+    // int, bool or float as a double
+    double to_float() const { return _type == Type::Float ? _float : double(to_int()); }
+    // int, bool or float as an integer, floats are truncated
+    int64_t to_int() const {
+        return _type == Type::Float ? int64_t(_float) : _int;
     }
 
     int64_t get_int() const {
-        return std::visit(
-                [](auto&& v) -> int64_t {
-                    using T = std::decay_t<decltype(v)>;
-                    if constexpr (std::is_same_v<T, std::string>) {
-                        return std::stoll(v);
-                    } else {
-                        return v;
-                    }
-                },
-                getSumType());
+        auto& v = deref();
+        if (v.is_str()) {
+            auto i = Number::parse_leading_int(v.as_string());
+            CHECK(i, "can not convert \"" + v.as_string() + "\" to int");
+            return *i;
+        }
+        CHECK(v.is_number(), "should not reach here.");
+        return v.to_int();
     }
 
     bool get_bool() const { return get_int(); }
 
-    Value& operator[](Value idx) {
-        if (is_ref()) return ref()[idx];
-        auto& arr = std::get<ArrValue>(_value).arr();
-        int id = idx.get_int();
-        CHECK(id < arr.size(), "out of bound in arr" + std::string(" now size ") +
-                                       std::to_string(arr.size()) + " want " + std::to_string(id));
-        return arr[id];
+    // idx as an element index of arr, checked against its size
+    static size_t checked_index(const Array& arr, const Value& idx) {
+        int64_t id = idx.get_int();
+        CHECK(id >= 0 && uint64_t(id) < arr.size(),
+              "out of bound in arr" + std::string(" now size ") + std::to_string(arr.size()) +
+                      " want " + std::to_string(id));
+        return size_t(id);
     }
 
-    std::vector<Value> get_arr() {
-        if (is_ref()) return ref().get_arr();
-        auto& arr = std::get<ArrValue>(_value).arr();
-        return arr;
+    // read only views, following refs. valid while this value is alive and unchanged.
+    const Array& get_array() const {
+        auto& v = deref();
+        CHECK(v.is_arr(), "[] must be used on an arr, now is " + type_to_str(v.type()));
+        return v._arr->data;
     }
 
-    Value& operator[](const std::string& member_name) {
-        if (is_ref()) return ref()[member_name];
-        auto& map = std::get<StructValue>(_value).map();
-        return map[member_name];
+    // the array behind any refs for writing, unshared first. a slice gets its own copy of its
+    // elements here.
+    Array& write_array() {
+        if (is_ref()) return ref().write_array();
+        CHECK(is_arr(), "[] must be used on an arr, now is " + type_to_str(type()));
+        auto& arr = unshare(_arr);
+        if (arr.kind() == Array::Kind::View) arr.materialize();
+        return arr;
     }
 
-    std::map<std::string, Value> get_struct() {
-        if (is_ref()) return ref().get_struct();
-        auto& map = std::get<StructValue>(_value).map();
-        return map;
+    // a[lo:hi], sharing the elements of a until either is written
+    Value slice(int64_t lo, int64_t hi) const;
+
+    // member access for writing, a missing member is added. the slot found is kept in cache
+    // and reused while the struct has the same shape.
+    Value& member(SymbolId name, MemberCache& cache) {
+        if (is_ref()) return ref().member(name, cache);
+        CHECK(is_struct(), ". must be used on a struct, now is " + type_to_str(type()));
+        auto& members = unshare(_struct);
+        if (members.shape != cache.shape) {
+            auto& v = members[name];
+            cache = {members.shape, uint32_t(&v - members.slots.data())};
+            return v;
+        }
+        return members.slots[cache.slot];
     }
 
-    // make function
-    template <typename CppType>
-        requires(std::is_integral_v<CppType>)
-    static auto make_Int(const CppType& rhs) {
-        return Value {IntValue(rhs)};
+    // member access for reading, nullptr when the member is missing
+    const Value* find_member(SymbolId name, MemberCache& cache) const {
+        auto& v = deref();
+        CHECK(v.is_struct(), ". must be used on a struct, now is " + type_to_str(v.type()));
+        auto& members = v._struct->data;
+        if (members.shape != cache.shape) {
+            auto slot = members.shape->slot(name);
+            if (slot == Shape::npos) return nullptr;
+            cache = {members.shape, slot};
+        }
+        return &members.slots[cache.slot];
     }
 
-    template <typename CppType>
-        requires(std::is_same_v<CppType, bool>)
-    static auto make_Bool(const CppType& rhs) {
-        return Value {BoolValue(rhs)};
+    const StructMembers& get_struct() const {
+        auto& v = deref();
+        CHECK(v.is_struct(), "must be a struct, now is " + type_to_str(v.type()));
+        return v._struct->data;
     }
 
-    template <typename CppType>
-        requires(std::is_floating_point_v<CppType>)
-    static auto make_Float(const CppType& rhs) {
-        return Value {FloatValue(rhs)};
-    }
-
-    template <typename CppType>
-        requires(std::is_same_v<CppType, std::string>)
-    static auto make_Int(const CppType& rhs) {
-        return Value {StringValue(rhs)};
-    }
+    // in Map.h
+    const Map& get_map() const;
+    // the map behind any refs for writing, unshared first
+    Map& write_map();
 
     static auto make_Ref(ReferenceWrapping ref) { return Value {ref}; }
 
-    static auto make_Arr(const std::vector<Value>& arr) {
+    // one shared string per distinct text, for literals and other constant strings. two
+    // interned strings are equal exactly when they are the same object.
+    static Value make_Interned(std::string_view text);
+    bool is_interned() const { return is_heap() && _heap->interned; }
+    // std::hash of the text of a string, stored on an interned one
+    size_t string_hash() const {
+        if (_str->interned) return static_cast<const InternedString*>(_str)->hash;
+        return std::hash<std::string_view>()(_str->data);
+    }
+
+    static auto make_Arr(Array arr) {
         Value v;
-        v._value = arr;
+        v._type = Type::Arr;
+        v._arr = new Shared<Array>(std::move(arr));
         return v;
     }
+    static auto make_Arr(std::vector<Value> arr) { return make_Arr(Array(std::move(arr))); }
 
-    static auto make_Struct(const std::map<std::string, Value>& map) {
+    static auto make_Struct(StructMembers map) {
         Value v;
-        v._value = map;
+        v._type = Type::Struct;
+        v._struct = new Shared<StructMembers>(std::move(map));
         return v;
     }
 
+    // an empty map
+    static Value make_Map();
+
     void assign_value(const Value& rhs) {
         if (is_ref()) {
             ref() = rhs;
@@ -283,11 +468,159 @@ struct Value {
             *this = rhs;
         }
     }
-    autoType& value() { return _value; }
 
 private:
-    autoType _value;
+    bool is_heap() const { return _type >= Type::String; }
+    void free_heap();
+
+    // the object for writing, copied first when another value shares it
+    template <typename T>
+    static T& unshare(Shared<T>*& object) {
+        if (object->interned) {
+            object = new Shared<T>(object->data);
+        } else if (object->refs > 1) {
+            object->refs--;
+            object = new Shared<T>(object->data);
+        }
+        return object->data;
+    }
+    void swap(Value& rhs) noexcept {
+        std::swap(_type, rhs._type);
+        std::swap(_int, rhs._int);
+    }
+
+    Type _type = Type::Int;
+    // bools are stored as 0 or 1 in _int
+    union {
+        int64_t _int;
+        double _float;
+        HeapObject* _heap;
+        Shared<std::string>* _str;
+        Shared<ReferenceWrapping>* _ref;
+        Shared<Array>* _arr;
+        Shared<StructMembers>* _struct;
+        Shared<Map>* _map;
+    };
 };
+static_assert(sizeof(Value) == 16);
+
+inline size_t Array::size() const {
+    return std::visit([](auto& buffer) { return buffer.size(); }, _data);
+}
+
+inline Value Array::get(size_t i) const {
+    switch (kind()) {
+    case Kind::Int:
+        return buffer<Ints>()[i];
+    case Kind::Bool:
+        return bool(buffer<Bools>()[i]);
+    case Kind::Float:
+        return buffer<Floats>()[i];
+    case Kind::Columns:
+        return row(i);
+    case Kind::View: {
+        auto& view = buffer<View>();
+        return view.items().get(view.offset + i);
+    }
+    case Kind::Sparse: {
+        auto& table = buffer<Sparse>();
+        if (!table.index.empty()) {
+            auto it = table.index.find(i);
+            if (it != table.index.end()) return table.boxed[it->second].second;
+        }
+        return table.dense->get(i);
+    }
+    default:
+        return buffer<Values>()[i];
+    }
+}
+
+inline bool Array::try_set(size_t i, const Value& v) {
+    switch (kind()) {
+    case Kind::Int:
+        if (v.type() != Type::Int) return false;
+        buffer<Ints>()[i] = v.as_int();
+        return true;
+    case Kind::Bool:
+        if (v.type() != Type::Bool) return false;
+        buffer<Bools>()[i] = v.as_bool();
+        return true;
+    case Kind::Float:
+        if (v.type() != Type::Float) return false;
+        buffer<Floats>()[i] = v.as_float();
+        return true;
+    case Kind::Columns:
+        return set_row(i, v);
+    case Kind::Sparse: {
+        auto& table = buffer<Sparse>();
+        auto it = table.index.find(i);
+        if (it != table.index.end()) {
+            table.boxed[it->second].second.assign_value(v);
+        } else if (!table.dense->try_set(i, v)) {
+            sparse_slot(i) = v;
+        }
+        return true;
+    }
+    default:
+        // an element holding a ref is written through, like any variable
+        buffer<Values>()[i].assign_value(v);
+        return true;
+    }
+}
+
+inline void Array::set(size_t i, const Value& v) {
+    if (try_set(i, v)) return;
+    box();
+    slot(i) = v;
+}
+
+inline Value& Array::slot(size_t i) {
+    if (kind() == Kind::Sparse) return sparse_slot(i);
+    if (kind() != Kind::Boxed) box();
+    if (kind() == Kind::Sparse) return sparse_slot(i);
+    return buffer<Values>()[i];
+}
+
+inline const Array& View::items() const {
+    return base->data;
+}
+
+inline Array::Kind Array::element_kind() const {
+    return kind() == Kind::View ? buffer<View>().items().kind() : kind();
+}
+
+template <typename Buffer>
+std::span<const typename Buffer::value_type> Array::elements() const {
+    if (kind() != Kind::View) return buffer<Buffer>();
+    auto& view = buffer<View>();
+    return std::span(view.items().buffer<Buffer>()).subspan(view.offset, view.length);
+}
+
+inline const Array* Array::column(SymbolId name, MemberCache& cache) const {
+    if (kind() != Kind::Columns) return nullptr;
+    auto& table = buffer<Columns>();
+    if (table.shape != cache.shape) {
+        auto slot = table.shape->slot(name);
+        if (slot == Shape::npos) return nullptr;
+        cache = {table.shape, slot};
+    }
+    return &table.columns[cache.slot];
+}
+
+inline const Value* StructMembers::find(SymbolId name) const {
+    auto slot = shape->slot(name);
+    return slot == Shape::npos ? nullptr : &slots[slot];
+}
+
+inline Value& StructMembers::operator[](SymbolId name) {
+    auto slot = shape->slot(name);
+    if (slot == Shape::npos) {
+        shape = shape->add(name);
+        slot = slots.size();
+        slots.emplace_back();
+    }
+    return slots[slot];
+}
 
 inline std::ostream& operator<<(std::ostream& out, const Value& v) {
     out << v.to_string();
@@ -305,12 +638,13 @@ inline Value Less(const Value& L, const Value& R) {
 inline Value Greater(const Value& L, const Value& R) {
     return !_less(L, R);
 }
+bool _equal(const Value& L, const Value& R);
 inline Value Equal(const Value& L, const Value& R) {
-    return Value {!_less(L, R) && !_less(R, L)};
+    return Value {_equal(L, R)};
 }
 
 inline Value NotEqual(const Value& L, const Value& R) {
-    return Value {!(!_less(L, R) && !_less(R, L))};
+    return Value {!_equal(L, R)};
 }
 
 inline Value GreaterOrEqual(const Value& L, const Value& R) {
@@ -8,44 +8,41 @@ struct Context;
 
 struct VariableMgr {
     VariableMgr(const std::string name) : _name(name) {}
-    Value& get(const std::string& name) {
-        if (!_mgr.contains(name)) {
-            _mgr[name] = (Value::default_value);
+    Value& get(SymbolId name) {
+        auto it = _mgr.find(name);
+        if (it == _mgr.end()) {
+            it = _mgr.emplace(name, Value::default_value).first;
         }
-        return _mgr[name];
+        return it->second;
     }
 
-    bool find(const std::string& name) { return _mgr.contains(name); }
+    bool find(SymbolId name) const { return _mgr.contains(name); }
 
-    void set(const std::string& name, const Value& v) { get(name) = v; }
+    void set(SymbolId name, const Value& v) { get(name) = v; }
 
-    ReferenceWrapping& get_ref(const std::string name) {
-        if (_ref_mgr.contains(name)) {
-            return _ref_mgr[name];
+    ReferenceWrapping& get_ref(SymbolId name) {
+        if (auto it = _ref_mgr.find(name); it != _ref_mgr.end()) {
+            return it->second;
         }
-        if (!_mgr.contains(name)) {
-            _mgr[name] = (Value::default_value);
-        }
-        _ref_mgr.insert({name, {_mgr.find(name), this}});
-        return _ref_mgr[name];
+        get(name);
+        return _ref_mgr.emplace(name, ReferenceWrapping {&*_mgr.find(name), this}).first->second;
     }
 
 private:
     friend class ReferenceWrapping;
-    friend class RefValue;
-    std::map<std::string, Value> _mgr;
-    std::map<std::string, ReferenceWrapping> _ref_mgr;
+    friend struct Value;
+    // unordered_map never moves its nodes, so ReferenceWrapping can point into it
+    std::unordered_map<SymbolId, Value> _mgr;
+    std::unordered_map<SymbolId, ReferenceWrapping> _ref_mgr;
     std::string _name;
 };
 
 struct StructInfoMgr {
-
-
-    void put_struct_info(const std::string& name, const std::map<std::string, Value>& map) {
+    void put_struct_info(SymbolId name, const StructMembers& map) {
         if (_mgr.contains(name)) {
-            auto new_map = std::get<StructValue>(_mgr[name].value()).map();
-            for (auto& [k, v] : map) {
-                new_map[k] = v;
+            auto new_map = _mgr[name].get_struct();
+            for (size_t i = 0; i < map.size(); i++) {
+                new_map[map.name(i)] = map.slots[i];
             }
             _mgr.erase(name);
             put(name, Value::make_Struct(new_map));
@@ -54,17 +51,20 @@ struct StructInfoMgr {
         }
     }
 
-    void extends(const std::string& name, const std::string& base) { _mgr[name] = _mgr[base]; }
-    Value get_default_struct_value(const std::string& name) {
-        CHECK(_mgr.contains(name), " can not find struct name : " + name);
-        return _mgr[name];
+    void extends(SymbolId name, SymbolId base) { _mgr[name] = _mgr[base]; }
+    bool contains(SymbolId name) const { return _mgr.contains(name); }
+    void erase(SymbolId name) { _mgr.erase(name); }
+    Value get_default_struct_value(SymbolId name) {
+        auto it = _mgr.find(name);
+        CHECK(it != _mgr.end(), " can not find struct name : " + symbol_name(name));
+        return it->second;
     }
 
-    private:
-    void put(const std::string& name, Value struct_v) {
+private:
+    void put(SymbolId name, Value struct_v) {
         CHECK(struct_v.is_struct(), " must be a struct value");
         _mgr.insert({name, struct_v});
     }
 
-    std::map<std::string, Value> _mgr;
-};
\ No newline at end of file
+    std::unordered_map<SymbolId, Value> _mgr;
+};
@@ -1,44 +1,113 @@
 #include "Vm.h"
 
-#include "Function.h"
+#include <poll.h>
+#include <sys/inotify.h>
 
+#include <chrono>
+#include <set>
 
+#include "Function.h"
+#include "Heap.h"
+#include "SourceFile.h"
+#include "ThreadPool.h"
+#include "UnitCache.h"
+
+VMOptions VMOptions::parse(int argc, char** argv) {
+    VMOptions options;
+    for (int i = 1; i < argc; i++) {
+        std::string_view arg = argv[i];
+        if (arg == "--symbol-report") {
+            options.symbol_report = true;
+        } else if (arg == "--jobs" && i + 1 < argc) {
+            auto jobs = Number::parse_int(argv[++i]);
+            if (!jobs || *jobs <= 0) {
+                std::cerr << "--jobs expects a positive number" << std::endl;
+                exit(1);
+            }
+            options.jobs = *jobs;
+        } else if (arg == "--no-cache") {
+            options.use_cache = false;
+        } else if (arg == "--rebuild-cache") {
+            options.rebuild_cache = true;
+        } else if (arg == "--watch") {
+            options.watch = true;
+        } else if (arg == "--lazy") {
+            options.lazy = true;
+        } else if (arg == "--no-prune") {
+            options.prune = false;
+        } else if (arg == "--prune-report") {
+            options.prune_report = true;
+        } else if (arg == "--gc-stats") {
+            options.gc_stats = true;
+        } else if (arg == "--gc-stress") {
+            options.gc_stress = true;
+        } else if (arg == "--max-heap" && i + 1 < argc) {
+            auto max_heap = Number::parse_int(argv[++i]);
+            if (!max_heap || *max_heap <= 0) {
+                std::cerr << "--max-heap expects a positive number" << std::endl;
+                exit(1);
+            }
+            options.max_heap = *max_heap;
+        } else {
+            std::cerr << "unknown option: " << arg << std::endl;
+            exit(1);
+        }
+    }
+    // reloading rebinds calls found while preparing, lazy bodies are prepared too late for it
+    if (options.watch && options.lazy) {
+        std::cerr << "--lazy can not be combined with --watch" << std::endl;
+        exit(1);
+    }
+    return options;
+}
 
-void VM::run() {
+int VM::run() {
     // by gpt
     std::filesystem::path currentPath = std::filesystem::current_path();
 
     std::string fileExtension = ".ycc";
 
-    auto _global_ctx = std::make_unique<GlobalContext>();
-    Context ctx {_global_ctx.get()};
-
-
+    std::vector<std::filesystem::path> paths;
     for (const auto& entry : std::filesystem::directory_iterator(currentPath)) {
-
         if (entry.path().extension() == fileExtension) {
-
-            std::ifstream file(entry.path());
-            if (file.is_open()) {
-                std::stringstream buffer;
-                buffer << file.rdbuf();
-                auto Text = buffer.str();
-                build(Text,&ctx);
-                file.close();
-            } else {
-                std::cerr << "Error opening file: " << entry.path() << std::endl;
-            }
+            paths.push_back(entry.path());
         }
     }
+    // directory order is unspecified, merge in path order so the result does not depend on it
+    std::sort(paths.begin(), paths.end());
+    std::vector<CompileUnit> units(paths.begin(), paths.end());
+
+    Heap::configure(_options.gc_stats, _options.gc_stress, _options.max_heap);
+    ThreadPool pool(_options.jobs ? _options.jobs : ThreadPool::default_size());
+    pool.parallel_for(units.size(), [&](size_t i) { build(units[i]); });
+
+    _global_ctx = std::make_unique<GlobalContext>();
+    if (_options.watch) _global_ctx->track_call_sites();
+    for (auto& unit : units) {
+        if (unit.failed()) {
+            std::cerr << unit.error() << std::endl;
+            return 1;
+        }
+        _global_ctx->merge(std::move(unit));
+    }
+    // a reload may call anything again, and lazy bodies are not parsed yet
+    if (_options.prune && !_options.watch && !_options.lazy) prune();
+    _global_ctx->prepare(&pool);
+
+    run_main();
+    if (_options.watch) {
+        std::cout << std::flush;
+        watch();
+    }
 
-
-    ctx.global()->prepare(&ctx);
-
-    auto main_func = ctx.func_mgr()->get_func({"main", 0});
-
-    auto ret = main_func->exce(&ctx, {});
-
-    std::cout << "end and return : " << ret << "\n";
+    if (_options.symbol_report) {
+        std::cerr << SymbolTable::instance().memory_report() << std::endl;
+    }
+    if (_options.gc_stats) {
+        Heap::collect();
+        std::cerr << Heap::report() << std::endl;
+    }
+    return 0;
 
     // 输出全部经过优化后的代码，还没写完
     // std::cout << "tree : "
@@ -50,8 +119,131 @@ void VM::run() {
 
 
 
-void VM::build(std::string& text , Context * ctx) {
-    text += "                           ";
-    auto tokenstream = Tokenizer::get_token_stream(text);
-    BuildAst::buildAst(tokenstream, ctx);
+void VM::build(CompileUnit& unit) {
+    auto file_name = unit.path().filename().string();
+    SourceFile source(unit.path());
+    if (!source.is_open()) {
+        unit.set_error("Error opening file: " + file_name);
+        return;
+    }
+    const auto hash = UnitCache::content_hash(source.text());
+    unit.set_source_hash(hash);
+    // a cached unit holds every body already parsed, lazy mode parses only what runs
+    const bool use_cache = _options.use_cache && !_options.lazy;
+    const auto cache_file = UnitCache::cache_path(unit.path());
+    if (use_cache && !_options.rebuild_cache && UnitCache::load(cache_file, hash, unit)) {
+        return;
+    }
+    auto text = source.text();
+    // lazy bodies are parsed from the mapping later, the unit keeps it
+    if (_options.lazy) unit.keep_source(std::move(source));
+    try {
+        // tokens are views into the mapping, which stays alive until the ast is built
+        auto tokenstream = Tokenizer::get_token_stream(text);
+        Context ctx {nullptr, &unit};
+        BuildAst::buildAst(tokenstream, &ctx);
+    } catch (const ParseError& e) {
+        unit.set_error(file_name + ":" + e.what());
+        return;
+    }
+    for (auto& func : unit.funcs()) {
+        func.node->fold();
+    }
+    if (use_cache) {
+        UnitCache::store(cache_file, hash, unit);
+    }
+}
+
+void VM::prune() {
+    auto report = _global_ctx->prune({intern("main"), 0});
+    if (!_options.prune_report) return;
+    std::cerr << "pruned " << report.removed_funcs.size() << " functions and "
+              << report.removed_structs.size() << " structs not reachable from main, kept "
+              << report.kept_funcs << " functions, nodes " << report.bytes_before / 1024
+              << " KB -> " << report.bytes_after / 1024 << " KB" << std::endl;
+    for (auto& [file_name, signature] : report.removed_funcs) {
+        std::cerr << "  " << file_name << ": " << symbol_name(signature.first) << "/"
+                  << signature.second << "\n";
+    }
+    for (auto name : report.removed_structs) {
+        std::cerr << "  struct " << symbol_name(name) << "\n";
+    }
+}
+
+void VM::run_main() {
+    Context ctx {_global_ctx.get()};
+    FunctionSignature signature {intern("main"), 0};
+    // while watching, a missing main is only reported, it may come back with the next change
+    if (_options.watch && !ctx.func_mgr()->find_func(signature)) {
+        std::cerr << "can not find funciton name main" << std::endl;
+        return;
+    }
+    auto main_func = ctx.func_mgr()->get_func(signature);
+
+    auto ret = main_func->exce(&ctx, {});
+
+    std::cout << "end and return : " << ret << "\n";
+}
+
+void VM::watch() {
+    int fd = inotify_init1(IN_CLOEXEC);
+    CHECK(fd >= 0, "inotify_init1 failed");
+    // editors either write in place or write aside and rename over the file
+    auto mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE;
+    CHECK(inotify_add_watch(fd, std::filesystem::current_path().c_str(), mask) >= 0,
+          "inotify_add_watch failed");
+    std::cerr << "watching " << std::filesystem::current_path().string() << std::endl;
+
+    alignas(inotify_event) char buffer[64 * 1024];
+    while (true) {
+        // one save often comes as several events, collect until things are quiet for a moment
+        std::set<std::filesystem::path> changed;
+        pollfd pfd {fd, POLLIN, 0};
+        for (int timeout = -1; poll(&pfd, 1, timeout) > 0; timeout = 50) {
+            auto size = read(fd, buffer, sizeof(buffer));
+            if (size <= 0) break;
+            for (char* p = buffer; p < buffer + size;) {
+                auto* event = reinterpret_cast<inotify_event*>(p);
+                std::filesystem::path name = event->len ? event->name : "";
+                if (name.extension() == ".ycc") {
+                    changed.insert(std::filesystem::current_path() / name);
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        bool reloaded = false;
+        for (auto& path : changed) reloaded |= reload(path);
+        if (reloaded) run_main();
+        std::cout << std::flush;
+    }
+}
+
+bool VM::reload(const std::filesystem::path& path) {
+    auto start = std::chrono::steady_clock::now();
+    auto file_name = path.filename().string();
+    CompileUnit unit(path);
+    // a removed file is swapped for an empty unit
+    if (std::filesystem::exists(path)) {
+        // saving without changes touches the file too
+        auto* current = _global_ctx->unit(path);
+        if (SourceFile source(path); current && source.is_open() &&
+                                     UnitCache::content_hash(source.text()) == current->source_hash()) {
+            return false;
+        }
+        build(unit);
+        if (unit.failed()) {
+            std::cerr << unit.error() << std::endl;
+            return false;
+        }
+    }
+    ReloadReport report;
+    if (!_global_ctx->reload(std::move(unit), &report)) {
+        std::cerr << file_name << ": not reloaded, " << report.error << std::endl;
+        return false;
+    }
+    auto ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cerr << "reloaded " << file_name << ": " << report.replaced_funcs
+              << " functions replaced, " << report.rebound_calls << " calls rebound, "
+              << ms.count() << " ms" << std::endl;
+    return true;
 }
@@ -2,18 +2,60 @@
 #pragma once
 #include <unistd.h>
 
+#include <filesystem>
 #include <fstream>
 #include <iostream>
 #include <string>
 
+#include "CompileUnit.h"
 #include "Context.h"
 #include "ExprBuild.h"
 #include "Token.h"
 #include "Type.h"
 #include "Ast.h"
 #include "util.h"
+struct VMOptions {
+    // print the interned symbol table size after the run
+    bool symbol_report = false;
+    // threads used to parse files and prepare functions, 0 means one per core
+    size_t jobs = 0;
+    // load parsed units from .ycc_cache when the source is unchanged, and store them
+    bool use_cache = true;
+    // ignore existing cache entries and write them again
+    bool rebuild_cache = false;
+    // keep running: reload changed files and run main again after each change
+    bool watch = false;
+    // only match braces at load time, parse each function body on its first call
+    bool lazy = false;
+    // drop functions and structs main can not reach before preparing, see --no-prune
+    bool prune = true;
+    // list what pruning dropped
+    bool prune_report = false;
+    // print heap object counts and collection pauses after the run
+    bool gc_stats = false;
+    // free queued heap objects one at a time on every allocation, see Heap::configure
+    bool gc_stress = false;
+    // heap objects alive at most, 0 for no limit, see Heap::configure
+    size_t max_heap = 0;
+
+    static VMOptions parse(int argc, char** argv);
+};
+
 struct VM {
-    void build(std::string& text , Context * ctx);
-    void run();
+    VM() = default;
+    VM(const VMOptions& options) : _options(options) {}
+    // reads and parses one file into its unit, errors are recorded in the unit
+    void build(CompileUnit& unit);
+    // drops what main can not reach, prints the report with --prune-report
+    void prune();
+    // runs main once and prints its result
+    void run_main();
+    // the --watch loop, never returns
+    void watch();
+    // re-parses one changed, added or removed file and swaps it in, false if nothing changed
+    bool reload(const std::filesystem::path& path);
+    // returns the process exit code
+    int run();
     std::unique_ptr<GlobalContext> _global_ctx;
+    VMOptions _options;
 };
\ No newline at end of file
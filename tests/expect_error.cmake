@@ -0,0 +1,14 @@
+# runs DEMO in DIR with the options in ARGS and passes when it exits with an error and its
+# output matches EXPECT
+separate_arguments(ARGS)
+execute_process(COMMAND ${DEMO} --no-cache ${ARGS}
+                WORKING_DIRECTORY ${DIR}
+                RESULT_VARIABLE result
+                OUTPUT_VARIABLE output
+                ERROR_VARIABLE output)
+if(result EQUAL 0)
+    message(FATAL_ERROR "expected an error, the run succeeded:\n${output}")
+endif()
+if(NOT output MATCHES "${EXPECT}")
+    message(FATAL_ERROR "expected output matching \"${EXPECT}\", got:\n${output}")
+endif()
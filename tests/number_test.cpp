@@ -0,0 +1,91 @@
+// prints floats with Number::append and reads the text back the way a constant in the source
+// is read: one decimal token that parses to the same double, bit for bit
+#include <bit>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../src/ExprBuild.h"
+#include "../src/Number.h"
+#include "../src/Token.h"
+
+namespace {
+int failures = 0;
+
+void fail(double value, const std::string& text, const char* why) {
+    std::printf("%.17g printed as \"%s\": %s\n", value, text.c_str(), why);
+    failures++;
+}
+
+void read_back(double value) {
+    auto text = Number::to_string(value);
+    // a negative number is a '-' and a constant in the source
+    auto magnitude = text[0] == '-' ? text.substr(1) : text;
+    auto stream = Tokenizer::get_token_stream(magnitude);
+    auto token = stream.get();
+    if (token.literal() != Token::Literal::decimal) return fail(value, text, "not a decimal");
+    if (!stream.end()) return fail(value, text, "more than one token");
+    auto read = ExprBuild::parser_constant(token);
+    if (read.type() != Type::Float) return fail(value, text, "does not read as a float");
+    if (std::bit_cast<uint64_t>(read.as_float()) != std::bit_cast<uint64_t>(std::fabs(value))) {
+        fail(value, text, "reads back as another value");
+    }
+}
+
+void expect(double value, const std::string& text) {
+    auto printed = Number::to_string(value);
+    if (printed != text) fail(value, printed, ("expected \"" + text + "\"").c_str());
+}
+} // namespace
+
+int main() {
+    expect(0.0, "0.0");
+    expect(1.0, "1.0");
+    expect(-2.0, "-2.0");
+    expect(0.1, "0.1");
+    expect(1.5, "1.5");
+    expect(100000.0, "100000.0");
+    expect(123456789.0, "123456789.0");
+    expect(1e15, "1000000000000000.0");
+    expect(1e16, "1e16");
+    expect(0.0001, "0.0001");
+    expect(0.00001, "1e-05");
+    expect(1.0 / 3, "0.3333333333333333");
+    expect(-2.5e-7, "-2.5e-07");
+    expect(1e300, "1e300");
+
+    std::vector<double> values = {
+            0.0,
+            0.1,
+            0.3,
+            2.0 / 3,
+            9999999999999998.0,
+            1e16,
+            0.0001,
+            0.00009999999999999999,
+            std::numeric_limits<double>::max(),
+            std::numeric_limits<double>::min(),
+            std::numeric_limits<double>::denorm_min(),
+            std::numeric_limits<double>::epsilon(),
+    };
+    for (int e = -320; e <= 308; e++) values.push_back(std::pow(10.0, e));
+    std::mt19937_64 random(13);
+    std::uniform_real_distribution<double> mantissa(1, 10);
+    std::uniform_int_distribution<int> exponent(-12, 20);
+    for (int i = 0; i < 100000; i++) {
+        values.push_back(mantissa(random) * std::pow(10.0, exponent(random)));
+        values.push_back(-std::bit_cast<double>(random() & 0x7fefffffffffffff));
+    }
+    for (auto value : values) read_back(value);
+
+    if (failures) {
+        std::printf("%d failures\n", failures);
+        return 1;
+    }
+    std::printf("%zu floats read back\n", values.size());
+    return 0;
+}